@@ -1,6 +1,8 @@
 #include "ViewerApplication.hpp"
 
+#include <cstddef>
 #include <iostream>
+#include <limits>
 #include <numeric>
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -23,6 +25,60 @@ const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
 const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
 const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
 const GLuint VERTEX_ATTRIB_TANGENT_IDX = 3;
+// Per-instance attributes, one location per column
+const GLuint VERTEX_ATTRIB_MODEL_MATRIX_IDX = 4;
+const GLuint VERTEX_ATTRIB_NORMAL_MATRIX_IDX = 8;
+const GLuint VERTEX_ATTRIB_MATERIAL_IDX = 11;
+
+// glTF attributes read by the shaders
+const std::vector<std::pair<std::string, GLuint>> VERTEX_ATTRIBUTES = {
+    {"POSITION", VERTEX_ATTRIB_POSITION_IDX},
+    {"NORMAL", VERTEX_ATTRIB_NORMAL_IDX},
+    {"TEXCOORD_0", VERTEX_ATTRIB_TEXCOORD0_IDX},
+    {"TANGENT", VERTEX_ATTRIB_TANGENT_IDX},
+};
+
+// Uniform buffer binding point of the Material block of the shaders
+const GLuint MATERIAL_BLOCK_BINDING = 0;
+// Texture unit of the buffer texture viewing the material buffer as texels
+const GLuint MATERIAL_TEXTURE_UNIT = 5;
+
+// Element of the instance buffer, read with a divisor of 1
+struct InstanceData
+{
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix; // In world space
+    GLint materialTexel; // First texel of the material in the material buffer
+};
+
+// Source the per-instance attributes of the bound vertex array from
+// instanceBufferObject, advancing once per instance
+void setInstanceAttributes(GLuint instanceBufferObject)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBufferObject);
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        const auto attrib = VERTEX_ATTRIB_MODEL_MATRIX_IDX + column;
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (const GLvoid*) (offsetof(InstanceData, modelMatrix)
+                                               + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(attrib, 1);
+    }
+    for (GLuint column = 0; column < 3; ++column)
+    {
+        const auto attrib = VERTEX_ATTRIB_NORMAL_MATRIX_IDX + column;
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribPointer(attrib, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (const GLvoid*) (offsetof(InstanceData, normalMatrix)
+                                               + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(attrib, 1);
+    }
+    glEnableVertexAttribArray(VERTEX_ATTRIB_MATERIAL_IDX);
+    glVertexAttribIPointer(VERTEX_ATTRIB_MATERIAL_IDX, 1, GL_INT, sizeof(InstanceData),
+                           (const GLvoid*) offsetof(InstanceData, materialTexel));
+    glVertexAttribDivisor(VERTEX_ATTRIB_MATERIAL_IDX, 1);
+}
 
 
 
@@ -83,25 +139,79 @@ void keyCallback(
 
 int ViewerApplication::run()
 {
+  LoadReport loadReport;
+
   tinygltf::Model model;
+  GltfBuffers buffers;
   // DONE Loading the glTF file
 
-  loadGltfFile(model);
+  // Bytes of buffers and images available to the next stages
+  const auto getLoadedBytes = [&]() {
+    size_t bytes = 0;
+    for (const auto *spans :
+        {&buffers.spans, &buffers.encodedImages, &buffers.decodedImages}) {
+      for (const auto &span : *spans) {
+        bytes += span.size;
+      }
+    }
+    return bytes;
+  };
+
+  // A scene cache entry replaces the whole glTF loading when up to date,
+  // including the generation of the levels of detail
+  bool loadedFromCache = false;
+  LodChains lodChains;
+  if (!m_sceneCacheDirectory.empty()) {
+    loadReport.beginStage("load scene cache");
+    const SceneCache sceneCache{m_sceneCacheDirectory};
+    if (m_rebuildSceneCache) {
+      sceneCache.invalidate(m_gltfFilePath);
+    } else {
+      loadedFromCache =
+          sceneCache.load(m_gltfFilePath, model, buffers, lodChains);
+    }
+    loadReport.endStage(getLoadedBytes());
+  }
+
+  if (!loadedFromCache) {
+    loadReport.beginStage("load glTF");
+    if (!loadGltfFile(model, buffers)) {
+      return -1;
+    }
+    loadReport.endStage(getLoadedBytes());
+
+    // Scene cache entries are stored deduplicated
+    loadReport.beginStage("deduplicate resources");
+    const auto duplicates = deduplicateResources(model, buffers);
+    loadReport.endStage(duplicates.hashedBytes);
+    if (duplicates.bufferCount + duplicates.imageCount +
+            duplicates.textureCount > 0) {
+      std::cout << "Deduplicated " << duplicates.bufferCount << " buffers ("
+                << (duplicates.bufferBytes >> 10) << " KiB), "
+                << duplicates.imageCount << " images ("
+                << (duplicates.imageBytes >> 10) << " KiB encoded) and "
+                << duplicates.textureCount << " textures" << std::endl;
+    }
+  }
+
+  // Images are decoded by worker threads while the GL thread compiles
+  // shaders and creates buffers, they are uploaded at the end
+  ImageDecodeQueue imageDecodeQueue(m_threadPool, model, buffers.encodedImages);
 
 
 // Loader shaders
+  loadReport.beginStage("compile shaders");
   const auto glslProgram =
       compileProgram({m_ShadersRootPath / m_vertexShader,
           m_ShadersRootPath / m_fragmentShader});
+  loadReport.endStage();
 
-  const auto modelViewProjMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-  const auto modelViewMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-  const auto modelMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelMatrix");
-  const auto normalMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
+  // Model and normal matrices are per-instance attributes, only the camera
+  // matrices are uniforms
+  const auto viewMatrixLocation =
+      glGetUniformLocation(glslProgram.glId(), "uViewMatrix");
+  const auto projMatrixLocation =
+      glGetUniformLocation(glslProgram.glId(), "uProjMatrix");
 
   const auto lightDirLocation =
       glGetUniformLocation(glslProgram.glId(), "uLightDir");
@@ -109,31 +219,36 @@ int ViewerApplication::run()
       glGetUniformLocation(glslProgram.glId(), "uLightCol");
 
 
-  const auto baseColorTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture");
-
-  const auto baseColorFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uBaseColorFactor");
-
-  const auto metallicFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uMetallicFactor");
-  const auto roughnessFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uRoughnessFactor");
-  const auto metallicRoughnessTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture");
-
-  const auto emissiveFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uEmissiveFactor");
-  const auto emissiveTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture");
-
-  const auto occlusionFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionFactor");
-  const auto occlusionTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionTexture");
+  // The samplers read fixed texture units, set once
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture"), 0);
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture"), 1);
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture"), 2);
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uOcclusionTexture"), 3);
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uNormalTexture"), 4);
+  glProgramUniform1i(glslProgram.glId(),
+      glGetUniformLocation(glslProgram.glId(), "uMaterials"),
+      MATERIAL_TEXTURE_UNIT);
+
+  // Material factors are read from a range of the material buffer
+  const auto materialBlockIndex =
+      glGetUniformBlockIndex(glslProgram.glId(), "Material");
+  if (materialBlockIndex != GL_INVALID_INDEX)
+  {
+      glUniformBlockBinding(glslProgram.glId(), materialBlockIndex,
+                            MATERIAL_BLOCK_BINDING);
+  }
 
-  const auto normalTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalTexture");
+  // Whether the material factors are read from uMaterials, at the texel of
+  // the draw, instead of the Material block
+  const auto indexedMaterialsLocation =
+      glGetUniformLocation(glslProgram.glId(), "uIndexedMaterials");
+  const auto applyOcclusionLocation =
+      glGetUniformLocation(glslProgram.glId(), "uApplyOcclusion");
   const auto useNormalLocation =
       glGetUniformLocation(glslProgram.glId(), "uUseNormal");
   const auto renderModeLocation =
@@ -142,7 +257,82 @@ int ViewerApplication::run()
 
   // bounding box
   glm::vec3 bboxMin, bboxMax, bboxCenter, bboxDiag;
-  computeSceneBounds(model, bboxMin, bboxMax);
+  loadReport.beginStage("compute scene bounds");
+  computeSceneBounds(model, buffers, bboxMin, bboxMax);
+  loadReport.endStage();
+
+  // The hierarchy is flattened once, drawScene iterates over it linearly
+  loadReport.beginStage("flatten scene graph");
+  auto sceneGraph = flattenSceneGraph(model, model.defaultScene);
+  loadReport.endStage();
+  size_t updatedNodeCount = 0; // By the last frame
+
+  // Bounds of each drawn primitive, tested against the view frustum
+  loadReport.beginStage("compute primitive bounds");
+  auto primitiveInstances = buildPrimitiveInstances(model, buffers, sceneGraph);
+  loadReport.endStage();
+  std::vector<uint8_t> visiblePrimitives;
+  size_t visiblePrimitiveCount = 0; // In the last frame
+
+  // Small primitives kept on the CPU to be rasterized as occluders, built
+  // when occlusion culling is first enabled. With m_gpuResident, they are
+  // built at load: the buffers are released once uploaded.
+  const size_t maxOccluderTriangleCount = 1024; // Per primitive
+  const size_t occluderTriangleBudget = 16384; // Per frame
+  std::vector<std::vector<OccluderMesh>> occluderMeshes;
+  bool occluderMeshesBuilt = false;
+  const auto buildOccluders = [&]() {
+    occluderMeshes =
+        buildOccluderMeshes(model, buffers, maxOccluderTriangleCount);
+    occluderMeshesBuilt = true;
+  };
+  if (m_gpuResident) {
+    loadReport.beginStage("build occluder meshes");
+    buildOccluders();
+    loadReport.endStage();
+  }
+  OcclusionBuffer occlusionBuffer(m_threadPool, 256,
+      std::max(1, 256 * int(m_nWindowHeight) / int(m_nWindowWidth)));
+  OcclusionStats occlusionStats; // Of the last frame
+
+  // Simplified index buffers of the primitives, drawn with their vertices
+  const size_t maxLodLevelCount = 4;
+  if (!loadedFromCache) {
+    loadReport.beginStage("build LOD chains");
+    lodChains = buildLodChains(model, buffers, maxLodLevelCount);
+    loadReport.endStage(lodChains.indices.size() * sizeof(uint32_t));
+  }
+  std::vector<uint8_t> lodLevels;
+  size_t drawnTriangleCount = 0; // In the last frame
+
+  // Triangle primitives in shared vertex and index buffers, whose draws with
+  // the same textures are merged into one glMultiDrawElementsIndirect
+  MeshArena meshArena;
+  if (m_multiDrawIndirect)
+  {
+      loadReport.beginStage("build mesh arena");
+      meshArena = buildMeshArena(model, buffers, lodChains);
+      loadReport.endStage(meshArena.vertices.size() * sizeof(MeshArena::Vertex)
+                          + meshArena.indices.size() * sizeof(uint32_t));
+  }
+  std::vector<DrawElementsIndirectCommand> drawCommands;
+  // Commands of drawCommands drawn with the textures of material
+  struct DrawCommandBatch
+  {
+      int textureSet;
+      int material;
+      size_t firstCommand;
+      size_t commandCount;
+  };
+  std::vector<DrawCommandBatch> drawCommandBatches;
+
+  // Draws of a frame, sorted by the state they bind
+  const auto materialTextureSets = computeTextureSets(model);
+  std::vector<DrawItem> drawItems, drawItemScratch;
+  size_t materialBindCount = 0, vertexArrayBindCount = 0; // In the last frame
+  // Matrices of the draws, in the order of drawItems
+  std::vector<InstanceData> instanceData;
+  size_t drawCallCount = 0; // In the last frame
   bboxCenter = (bboxMin + bboxMax)*0.5f;
   bboxDiag = bboxMax - bboxMin;
 
@@ -181,9 +371,6 @@ int ViewerApplication::run()
   }
   
 
-  // DONE creation of Textures
-  const auto textures = createTextureObjects(model);
-
   // DONE creation of a white default texture
   GLuint whiteTexture;
   {
@@ -234,13 +421,177 @@ int ViewerApplication::run()
 
   
   // DONE Creation of Buffer Objects
-  const auto vbos = createBufferObjects(model);
+  // Only the bufferViews bound to the pipeline are uploaded
+  loadReport.beginStage("create buffer objects");
+  std::vector<std::string> vertexAttributeNames;
+  for (const auto & attribute: VERTEX_ATTRIBUTES)
+  {
+      vertexAttributeNames.push_back(attribute.first);
+  }
+  auto bufferLayout = computeCompactBufferLayout(model, vertexAttributeNames);
+  packLodIndices(lodChains, model, bufferLayout);
+  const auto vbos = createBufferObjects(model, buffers, bufferLayout, lodChains);
+  loadReport.endStage(std::accumulate(begin(bufferLayout.bufferSizes),
+                                      end(bufferLayout.bufferSizes), size_t(0)));
+
+  // Every material converted once to floats in one uniform buffer, each draw
+  // only binds the range of its material
+  loadReport.beginStage("create material buffer");
+  GLint uniformBufferAlignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+  const auto materialBuffer = packMaterials(model, size_t(uniformBufferAlignment));
+  GLuint materialBufferObject = 0;
+  glGenBuffers(1, &materialBufferObject);
+  glBindBuffer(GL_UNIFORM_BUFFER, materialBufferObject);
+  glBufferStorage(GL_UNIFORM_BUFFER, materialBuffer.bytes.size(),
+                  materialBuffer.bytes.data(), 0);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  // Also viewed as RGBA32F texels, one material every stride / 16 texels, for
+  // the merged draws that cannot bind the range of each material
+  GLuint materialTexture = 0;
+  GLint maxTextureBufferSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+  if (materialBuffer.bytes.size() / 16 > size_t(maxTextureBufferSize))
+  {
+      std::cerr << "Too many materials for a buffer texture, multi-draw "
+                   "indirect disabled" << std::endl;
+      meshArena = MeshArena();
+  }
+  else
+  {
+      glGenTextures(1, &materialTexture);
+      glActiveTexture(GL_TEXTURE0 + MATERIAL_TEXTURE_UNIT);
+      glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, materialBufferObject);
+      glActiveTexture(GL_TEXTURE0);
+  }
+  loadReport.endStage(materialBuffer.bytes.size());
+
+  // Filled each frame with the matrices of the visible instances
+  GLuint instanceBufferObject = 0;
+  glGenBuffers(1, &instanceBufferObject);
 
   // DONE Creation of Vertex Array Objects
+  loadReport.beginStage("create vertex array objects");
   std::vector<VaoRange> meshIndexToVaoRange;
   const auto vbas = createVertexArrayObjects(model,
                                              vbos,
+                                             instanceBufferObject,
+                                             bufferLayout,
                                              meshIndexToVaoRange);
+  loadReport.endStage();
+
+  GLuint meshArenaVao = 0;
+  GLuint meshArenaBuffers[2] = {0, 0}; // Vertices, indices
+  GLuint drawCommandBufferObject = 0; // Filled each frame with drawCommands
+  if (!meshArena.vertices.empty())
+  {
+      loadReport.beginStage("create mesh arena");
+      glGenBuffers(2, meshArenaBuffers);
+      glBindBuffer(GL_ARRAY_BUFFER, meshArenaBuffers[0]);
+      glBufferStorage(GL_ARRAY_BUFFER, meshArena.vertices.size() * sizeof(MeshArena::Vertex),
+                      meshArena.vertices.data(), 0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshArenaBuffers[1]);
+      glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, meshArena.indices.size() * sizeof(uint32_t),
+                      meshArena.indices.data(), 0);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+      glGenVertexArrays(1, &meshArenaVao);
+      glBindVertexArray(meshArenaVao);
+      glBindBuffer(GL_ARRAY_BUFFER, meshArenaBuffers[0]);
+      const auto stride = GLsizei(sizeof(MeshArena::Vertex));
+      glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
+      glVertexAttribPointer(VERTEX_ATTRIB_POSITION_IDX, 3, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid*) offsetof(MeshArena::Vertex, position));
+      glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL_IDX);
+      glVertexAttribPointer(VERTEX_ATTRIB_NORMAL_IDX, 3, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid*) offsetof(MeshArena::Vertex, normal));
+      glEnableVertexAttribArray(VERTEX_ATTRIB_TEXCOORD0_IDX);
+      glVertexAttribPointer(VERTEX_ATTRIB_TEXCOORD0_IDX, 2, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid*) offsetof(MeshArena::Vertex, texCoords));
+      glEnableVertexAttribArray(VERTEX_ATTRIB_TANGENT_IDX);
+      glVertexAttribPointer(VERTEX_ATTRIB_TANGENT_IDX, 4, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid*) offsetof(MeshArena::Vertex, tangent));
+      setInstanceAttributes(instanceBufferObject);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshArenaBuffers[1]);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glBindVertexArray(0);
+
+      glGenBuffers(1, &drawCommandBufferObject);
+      loadReport.endStage(meshArena.vertices.size() * sizeof(MeshArena::Vertex)
+                          + meshArena.indices.size() * sizeof(uint32_t));
+  }
+
+  // DONE creation of Textures
+  // When streamed, textures are uploaded by the render loop and materials use
+  // the default texture of each slot until they are available: whiteTexture
+  // for base color and occlusion, defaultNormalMapTexture for normals and none
+  // for metallic-roughness and emissive
+  std::vector<GLuint> textures;
+  std::unique_ptr<TextureStreamer> textureStreamer;
+  if (m_textureUploadBudget > 0) {
+    textureStreamer = std::make_unique<TextureStreamer>(
+        m_threadPool, model, buffers, imageDecodeQueue);
+  } else {
+    loadReport.beginStage("create texture objects");
+    textures = createTextureObjects(model, buffers, imageDecodeQueue);
+    size_t texelBytes = 0;
+    for (size_t i = 0; i < model.images.size(); ++i) {
+      texelBytes += getImagePixels(model, buffers, int(i)).size;
+    }
+    loadReport.endStage(texelBytes);
+  }
+  const auto streamingStart = loadReport.markMilliseconds();
+
+  // Once every texture is uploaded, the scene cache entry can be stored and,
+  // in GPU-resident mode, the CPU-side data released. That ends the loading.
+  bool uploadPending = true;
+  const auto endUpload = [&]() {
+    if (!uploadPending || (textureStreamer && !textureStreamer->done())) {
+      return;
+    }
+    uploadPending = false;
+
+    if (textureStreamer) {
+      LoadReport::Stage streaming;
+      streaming.name = "stream textures";
+      streaming.milliseconds = loadReport.markMilliseconds() - streamingStart;
+      streaming.async = true;
+      loadReport.addStage(streaming);
+    }
+    if (!model.images.empty() && !loadedFromCache) {
+      const auto decodeStats = imageDecodeQueue.stats();
+      LoadReport::Stage decoding;
+      decoding.name = "decode images";
+      decoding.milliseconds = decodeStats.milliseconds;
+      decoding.bytes = decodeStats.encodedBytes;
+      decoding.allocations = decodeStats.allocations;
+      decoding.async = true;
+      loadReport.addStage(decoding);
+    }
+
+    if (!m_sceneCacheDirectory.empty() && !loadedFromCache) {
+      loadReport.beginStage("store scene cache");
+      SceneCache{m_sceneCacheDirectory}.store(
+          m_gltfFilePath, model, buffers, lodChains);
+      loadReport.endStage(getLoadedBytes());
+    }
+    if (m_gpuResident) {
+      loadReport.beginStage("release CPU-side data");
+      const auto releasedBytes = releaseUploadedData(model, buffers);
+      loadReport.endStage(releasedBytes);
+      std::cout << "GPU-resident: released " << (releasedBytes >> 20)
+                << " MiB of CPU-side buffers and images" << std::endl;
+    }
+
+    std::cout << "Loading stages:" << std::endl;
+    loadReport.print(std::cout);
+    if (!m_loadReportPath.empty() && !loadReport.writeJson(m_loadReportPath)) {
+      std::cerr << "Unable to write load report " << m_loadReportPath << std::endl;
+    }
+  };
+  endUpload();
 
 
   
@@ -263,16 +614,28 @@ int ViewerApplication::run()
   bool normal_compute_on_fly = false;
   int render_mode = 0;
   int fps = 200;
+  int edited_node = 0;
+  bool frustum_culling = true;
+  bool hierarchical_culling = true;
+  bool occlusion_culling = false;
+  bool lod_enabled = true;
+  bool sort_draws = true;
+  bool gpu_instancing = true;
+  bool multi_draw_indirect = !meshArena.vertices.empty();
+  float lod_pixel_error = 1.f;
+  glm::vec3 edited_node_translation(0);
   
   
-  const auto bind_texture = [&](const auto tex, const auto texture_slot, const auto location)
+  // Every state change of drawScene goes through it, redundant ones are dropped
+  GLStateCache glState;
+
+  // Texture units of the samplers are set once at load
+  const auto bind_texture = [&](const auto tex, const auto texture_slot)
   {
-      glActiveTexture(GL_TEXTURE0 + texture_slot);
-      glBindTexture(GL_TEXTURE_2D, tex);
-      glUniform1i(location, texture_slot);
+      glState.bindTexture2D(GLuint(texture_slot), tex);
   };
 
-  const auto load_texture = [&](const auto index, const auto texture_slot, const auto location, const auto default_texture)
+  const auto load_texture = [&](const auto index, const auto texture_slot, const auto default_texture)
   {
       auto texture_obj = default_texture;
       if (index >= 0)
@@ -280,113 +643,67 @@ int ViewerApplication::run()
           const auto & texture = model.textures[index];
           if (texture.source >= 0)
           {
-              texture_obj = textures[texture.source];
+              const auto loaded = textureStreamer ? textureStreamer->texture(index) : textures[index];
+              if (loaded)
+              { // Else still streamed, the slot keeps its default
+                  texture_obj = loaded;
+              }
           }
       }
 
-      bind_texture(texture_obj, texture_slot, location);
+      bind_texture(texture_obj, texture_slot);
   };
 
 
   
   const auto bindMaterial = [&] (const auto materialIndex)
   {
+      // Factors packed at load, the default material last
+      glState.bindUniformBufferRange(MATERIAL_BLOCK_BINDING, materialBufferObject,
+                                     materialBuffer.offset(materialIndex, model),
+                                     sizeof(MaterialData));
       if (materialIndex >= 0)
       {
           // only valid is materialIndex >= 0
           const auto & material = model.materials[materialIndex];
           const auto & pbrMetallicRoughness = material.pbrMetallicRoughness;
 
-          glUniform4f(baseColorFactorLocation,
-                      (float)pbrMetallicRoughness.baseColorFactor[0],
-                      (float)pbrMetallicRoughness.baseColorFactor[1],
-                      (float)pbrMetallicRoughness.baseColorFactor[2],
-                      (float)pbrMetallicRoughness.baseColorFactor[3]);
-
           load_texture(pbrMetallicRoughness.baseColorTexture.index,
-                       0, baseColorTextureLocation, whiteTexture);
-
-          glUniform1f(metallicFactorLocation,
-                      (float)pbrMetallicRoughness.metallicFactor);
-          glUniform1f(roughnessFactorLocation,
-                      (float)pbrMetallicRoughness.roughnessFactor);
-
-
+                       0, whiteTexture);
           load_texture(pbrMetallicRoughness.metallicRoughnessTexture.index,
-                       1, metallicRoughnessTextureLocation, 0);
-
-
-          glUniform3f(emissiveFactorLocation,
-                      (float)material.emissiveFactor[0],
-                      (float)material.emissiveFactor[1],
-                      (float)material.emissiveFactor[2]);
-
-          load_texture(material.emissiveTexture.index,
-                       2, emissiveTextureLocation, 0);
-
-          if (apply_occlusion)
-          {
-              glUniform1f(occlusionFactorLocation,
-                          (float) material.occlusionTexture.strength);
-          }
-          else
-          {
-              glUniform1f(occlusionFactorLocation, 0.f);
-          }
-
-          load_texture(material.occlusionTexture.index,
-                       3, occlusionTextureLocation, whiteTexture);
+                       1, 0);
+          load_texture(material.emissiveTexture.index, 2, 0);
+          load_texture(material.occlusionTexture.index, 3, whiteTexture);
 
           // we do not use a default normal map
           if (apply_normal_map && material.normalTexture.index >= 0)
           {
 
-              glUniform1i(useNormalLocation, 1
+              glState.uniform1i(useNormalLocation, 1
                           + (((GLuint) normal_option_unsigned) << 1)
                           + (((GLuint) normal_option_2chan) << 2)
                           + (((GLuint) normal_option_greenup) << 3)
                           + (((GLuint) normal_compute_on_fly) << 4));
               load_texture(material.normalTexture.index,
-                           4, normalTextureLocation, defaultNormalMapTexture);
+                           4, defaultNormalMapTexture);
           }
           else
           {
 
-              glUniform1i(useNormalLocation, 0);
-              glActiveTexture(GL_TEXTURE4);
-              glBindTexture(GL_TEXTURE_2D, defaultNormalMapTexture);
-              glUniform1i(normalTextureLocation, 4);
+              glState.uniform1i(useNormalLocation, 0);
+              bind_texture(defaultNormalMapTexture, 4);
 
           }
       }
       else
       {
           std::cout << "no material found \n";
-          glUniform4f(baseColorFactorLocation,
-                      1.f,
-                      1.f,
-                      1.f,
-                      1.f);
-
-          bind_texture(whiteTexture, 0, baseColorTextureLocation);
-
-          glUniform1f(metallicFactorLocation, 1.f);
-          glUniform1f(roughnessFactorLocation, 1.f);
-
-          bind_texture(whiteTexture, 1, metallicRoughnessTextureLocation);
-
-          glUniform3f(emissiveFactorLocation, 0.f, 0.f, 0.f);
-
-          bind_texture(0, 2, emissiveTextureLocation);
-
-          glUniform1f(occlusionFactorLocation, 0.f);
-
-          bind_texture(0, 3, occlusionTextureLocation);
-          
-          bind_texture(0, 4, normalTextureLocation);
-          glUniform1i(useNormalLocation, 0);
-
-          
+          bind_texture(whiteTexture, 0);
+          bind_texture(whiteTexture, 1);
+          bind_texture(0, 2);
+          bind_texture(0, 3);
+          bind_texture(0, 4);
+          glState.uniform1i(useNormalLocation, 0);
       }
 
   };
@@ -399,9 +716,18 @@ int ViewerApplication::run()
       glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      glUniform1i(renderModeLocation, render_mode);
+      // ImGui, the texture streamer and renderToImage() bind state behind the
+      // back of the cache
+      glState.invalidate();
+      glState.resetCounters();
+      glState.useProgram(glslProgram.glId());
+      glState.uniform1i(renderModeLocation, render_mode);
+      glState.uniform1i(applyOcclusionLocation, apply_occlusion ? 1 : 0);
+      glState.uniform1i(indexedMaterialsLocation, 0);
       
       const auto viewMatrix = camera.getViewMatrix();
+      glState.uniformMatrix4f(viewMatrixLocation, viewMatrix);
+      glState.uniformMatrix4f(projMatrixLocation, projMatrix);
       
       const auto sin_phi = std::sin(light_phi);
       const auto cos_phi = std::cos(light_phi);
@@ -423,103 +749,222 @@ int ViewerApplication::run()
       
       const auto light_intensity_color = light_intensity * light_col;
       
-      glUniform3fv(lightDirLocation, 1, glm::value_ptr(light_viewspace_dir));
-      glUniform3fv(lightColLocation, 1, glm::value_ptr(light_intensity_color));
+      glState.uniform3f(lightDirLocation, light_viewspace_dir);
+      glState.uniform3f(lightColLocation, light_intensity_color);
 
+    // Only the subtrees of the nodes moved since the last frame
+    updatedNodeCount = updateDirtyWorldMatrices(sceneGraph);
+    updatePrimitiveInstances(primitiveInstances, sceneGraph);
 
-    // The recursive function that should draw a node
-    // We use a std::function because a simple lambda cannot be recursive
-    const std::function<void(int, const glm::mat4 &)> drawNode =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix)
+    if (frustum_culling && hierarchical_culling)
+    {
+        visiblePrimitiveCount = cullPrimitiveInstancesHierarchically(
+            primitiveInstances, extractFrustum(projMatrix * viewMatrix),
+            visiblePrimitives);
+    }
+    else if (frustum_culling)
+    {
+        visiblePrimitiveCount = cullPrimitiveInstances(primitiveInstances,
+            extractFrustum(projMatrix * viewMatrix), visiblePrimitives);
+    }
+    else
+    {
+        visiblePrimitives.assign(primitiveInstances.size(), 1);
+        visiblePrimitiveCount = primitiveInstances.size();
+    }
+    // Only the MSFT_lod level matching the screen coverage of its node
+    const auto eye = camera.eye();
+    visiblePrimitiveCount -= selectMsftLods(primitiveInstances, eye,
+        projMatrix[1][1], visiblePrimitives);
+    if (occlusion_culling)
+    {
+        if (!occluderMeshesBuilt)
         {
-            // DOING The drawNode function
-            const auto & node = model.nodes[nodeIdx];
-            const auto modelMatrix = getLocalToWorldMatrix(node, parentMatrix); 
-            if (node.mesh >= 0)
-            { 
-                const auto modelViewMatrix = viewMatrix * modelMatrix;
-                const auto modelViewProjMatrix = projMatrix * modelViewMatrix;
-                const auto normalMatrix = glm::transpose(glm::inverse(modelViewMatrix));
-
-                glUniformMatrix4fv(modelMatrixLocation,
-                                   1, GL_FALSE,
-                                   glm::value_ptr(modelMatrix));
-                glUniformMatrix4fv(modelViewMatrixLocation,
-                                   1, GL_FALSE,
-                                   glm::value_ptr(modelViewMatrix));
-                glUniformMatrix4fv(modelViewProjMatrixLocation,
-                                   1, GL_FALSE,
-                                   glm::value_ptr(modelViewProjMatrix));
-                glUniformMatrix4fv(normalMatrixLocation,
-                                   1, GL_FALSE,
-                                   glm::value_ptr(normalMatrix));
-
-
-                const auto & mesh = model.meshes[node.mesh];
-                const auto & vaoRange = meshIndexToVaoRange[node.mesh];
-                auto primIdx = 0;
-
-                for (const auto & prim: mesh.primitives)
-                {
-                    bindMaterial(prim.material);
-
-                    
-                    
-                    const auto & vao = vbas[vaoRange.begin + primIdx];
-
-                    glBindVertexArray(vao);
-
-                    if (prim.indices >= 0)
-                    { // indices case
-                        const auto & accessor = model.accessors[prim.indices];
-                        const auto & bufferView = model.bufferViews[accessor.bufferView];
-                        const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
-
-                        glDrawElements(prim.mode,
-                                       accessor.count,
-                                       accessor.componentType,
-                                       (GLvoid*) byteOffset);
-
-                    }
-                    else
-                    { // no indices case
-                        const auto accessorIdx = (*begin(prim.attributes)).second;
-                        const auto & accessor = model.accessors[accessorIdx];
-                        glDrawArrays(prim.mode, 0, accessor.count);
-                    }
-                    //glBindVertexArray(0);
-                    primIdx++;
-                }
-
+            buildOccluders();
+        }
+        visiblePrimitiveCount = cullOccludedInstances(occlusionBuffer,
+            primitiveInstances, sceneGraph, occluderMeshes,
+            projMatrix * viewMatrix, occluderTriangleBudget,
+            visiblePrimitives, occlusionStats);
+    }
+    drawnTriangleCount = selectLods(lodChains, model, primitiveInstances,
+        sceneGraph, eye, m_nWindowHeight * projMatrix[1][1] * 0.5f,
+        lod_enabled ? lod_pixel_error : 0.f, visiblePrimitives, lodLevels);
+
+    // Draw list of the visible primitives, sorted by texture set, material,
+    // vertex array and level of detail. The sort is stable: draws with the
+    // same state stay in the order of the nodes of sceneGraph.
+    drawItems.clear();
+    for (size_t instanceIdx = 0; instanceIdx < primitiveInstances.size(); ++instanceIdx)
+    {
+        if (!visiblePrimitives[instanceIdx])
+        {
+            continue;
+        }
+        const auto meshIdx = primitiveInstances.meshes[instanceIdx];
+        const auto primIdx = primitiveInstances.primitives[instanceIdx];
+        const auto material = model.meshes[meshIdx].primitives[primIdx].material;
+        const auto key =
+            makeDrawKey(material >= 0 ? materialTextureSets[material] : -1,
+                        material, size_t(meshIndexToVaoRange[meshIdx].begin + primIdx),
+                        lodLevels[instanceIdx]);
+        drawItems.push_back(DrawItem{key, uint32_t(instanceIdx)});
+    }
+    if (sort_draws)
+    {
+        sortDrawItems(drawItems, drawItemScratch);
+    }
 
-            
-            
+    // Matrices of the draws in draw order: a run of draws of the same
+    // primitive reads a contiguous range of the instance buffer, from its
+    // base instance
+    instanceData.resize(drawItems.size());
+    for (size_t drawIdx = 0; drawIdx < drawItems.size(); ++drawIdx)
+    {
+        const auto instanceIdx = drawItems[drawIdx].instance;
+        auto & instance = instanceData[drawIdx];
+        instance.modelMatrix = getWorldMatrix(primitiveInstances, sceneGraph, instanceIdx);
+        instance.normalMatrix = primitiveInstances.gpuInstances[instanceIdx] < 0
+            ? sceneGraph.normalMatrices[primitiveInstances.nodes[instanceIdx]]
+            : computeNormalMatrix(instance.modelMatrix);
+        const auto & prim = model.meshes[primitiveInstances.meshes[instanceIdx]]
+                                .primitives[primitiveInstances.primitives[instanceIdx]];
+        instance.materialTexel = GLint(materialBuffer.offset(prim.material, model) / 16);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(InstanceData),
+                 instanceData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Submit the draws, skipping the binds of the state already bound. With
+    // gpu_instancing, consecutive draws of the same primitive and level of
+    // detail are one instanced draw. With multi_draw_indirect, the draws in
+    // the mesh arena become commands, submitted after the loop.
+    auto currentMaterial = std::numeric_limits<int>::min();
+    auto currentVao = std::numeric_limits<size_t>::max();
+    materialBindCount = 0;
+    vertexArrayBindCount = 0;
+    drawCallCount = 0;
+    drawCommands.clear();
+    drawCommandBatches.clear();
+    for (size_t drawIdx = 0; drawIdx < drawItems.size();)
+    {
+        const auto instanceIdx = drawItems[drawIdx].instance;
+        // MSFT_lod levels are instances of other meshes on the same node
+        const auto meshIdx = primitiveInstances.meshes[instanceIdx];
+        const auto primIdx = primitiveInstances.primitives[instanceIdx];
+        const auto lodLevel = lodLevels[instanceIdx];
+
+        const auto baseInstance = drawIdx;
+        for (++drawIdx; gpu_instancing && drawIdx < drawItems.size(); ++drawIdx)
+        {
+            const auto nextIdx = drawItems[drawIdx].instance;
+            if (primitiveInstances.meshes[nextIdx] != meshIdx ||
+                primitiveInstances.primitives[nextIdx] != primIdx ||
+                lodLevels[nextIdx] != lodLevel)
+            {
+                break;
             }
-            for (const auto & child: node.children)
+        }
+        const auto instanceCount = GLsizei(drawIdx - baseInstance);
+
+        const auto & prim = model.meshes[meshIdx].primitives[primIdx];
+        const auto arenaRange = multi_draw_indirect
+            ? meshArena.find(meshIdx, primIdx, lodLevel)
+            : nullptr;
+        if (arenaRange)
+        { // Materials only differ by their factors within a texture set
+            const auto textureSet = prim.material >= 0 ? materialTextureSets[prim.material] : -1;
+            if (drawCommandBatches.empty() || drawCommandBatches.back().textureSet != textureSet)
             {
-                drawNode(child, modelMatrix);
+                drawCommandBatches.push_back(
+                    DrawCommandBatch{textureSet, prim.material, drawCommands.size(), 0});
             }
+            drawCommands.push_back(DrawElementsIndirectCommand{
+                arenaRange->indexCount, uint32_t(instanceCount), arenaRange->firstIndex,
+                arenaRange->baseVertex, uint32_t(baseInstance)});
+            ++drawCommandBatches.back().commandCount;
+            continue;
+        }
+
+        if (prim.material != currentMaterial)
+        {
+            currentMaterial = prim.material;
+            bindMaterial(prim.material);
+            ++materialBindCount;
+        }
+
+        const auto vaoIdx = size_t(meshIndexToVaoRange[meshIdx].begin + primIdx);
+        if (vaoIdx != currentVao)
+        {
+            currentVao = vaoIdx;
+            glState.bindVertexArray(vbas[vaoIdx]);
+            ++vertexArrayBindCount;
+        }
 
-            
-        };
+        if (lodLevel > 0)
+        { // generated level of detail, 32-bit indices
+            const auto & lod = lodChains.meshes[meshIdx][primIdx][lodLevel - 1];
+            glDrawElementsInstancedBaseInstance(prim.mode < 0 ? GL_TRIANGLES : prim.mode,
+                                                GLsizei(lod.indexCount),
+                                                GL_UNSIGNED_INT,
+                                                (GLvoid*) lod.byteOffset,
+                                                instanceCount,
+                                                GLuint(baseInstance));
+        }
+        else if (prim.indices >= 0)
+        { // indices case
+            const auto & accessor = model.accessors[prim.indices];
+            const auto byteOffset = bufferLayout.bufferViewOffsets[accessor.bufferView] + accessor.byteOffset;
+
+            glDrawElementsInstancedBaseInstance(prim.mode,
+                                                accessor.count,
+                                                accessor.componentType,
+                                                (GLvoid*) byteOffset,
+                                                instanceCount,
+                                                GLuint(baseInstance));
 
+        }
+        else
+        { // no indices case
+            const auto accessorIdx = (*begin(prim.attributes)).second;
+            const auto & accessor = model.accessors[accessorIdx];
+            glDrawArraysInstancedBaseInstance(prim.mode, 0, accessor.count,
+                                              instanceCount, GLuint(baseInstance));
+        }
+        ++drawCallCount;
+    }
 
-    
-    // Draw the scene referenced by gltf file
-    if (model.defaultScene >= 0)
+    if (!drawCommands.empty())
     {
-        // DONE Draw all nodes
-        for (const auto & node: model.scenes[model.defaultScene].nodes)
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBufferObject);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     drawCommands.size() * sizeof(DrawElementsIndirectCommand),
+                     drawCommands.data(), GL_STREAM_DRAW);
+        glState.uniform1i(indexedMaterialsLocation, 1);
+        glState.bindVertexArray(meshArenaVao);
+        ++vertexArrayBindCount;
+        for (const auto & batch : drawCommandBatches)
         {
-            // node is an int
-            drawNode(node, glm::mat4(1));
+            bindMaterial(batch.material);
+            ++materialBindCount;
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const GLvoid*) (batch.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                GLsizei(batch.commandCount), 0);
+            ++drawCallCount;
         }
-        
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     }
   };
 
   if (!m_OutputPath.empty())
   {
+      if (textureStreamer)
+      {
+          textureStreamer->finish();
+          endUpload();
+      }
+
       const auto w = m_nWindowWidth;
       const auto h = m_nWindowHeight;
       const auto channels = 3;
@@ -528,6 +973,10 @@ int ViewerApplication::run()
       renderToImage(w, h, channels, test_image.data(),
                     [&]() {drawScene(cameras[camera_index]->getCamera());});
       flipImageYAxis(w, h, channels, test_image.data());
+      std::cout << "Rendered " << drawItems.size() << " primitives in "
+                << drawCallCount << " draw calls, GL state calls: "
+                << glState.counters().issued << " issued, "
+                << glState.counters().elided << " elided" << std::endl;
       const auto strPath = m_OutputPath.string();
       stbi_write_png(
           strPath.c_str(), m_nWindowWidth, m_nWindowHeight, 3, test_image.data(), 0);
@@ -542,6 +991,12 @@ int ViewerApplication::run()
       Delayer _delayer(1000000/fps);
       const auto seconds = glfwGetTime();
 
+      if (textureStreamer && !textureStreamer->done())
+      {
+          textureStreamer->update(m_textureUploadBudget);
+          endUpload();
+      }
+
       const auto camera = cameras[camera_index]->getCamera();
       drawScene(camera);
 
@@ -553,6 +1008,10 @@ int ViewerApplication::run()
           ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                       1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
           ImGui::SliderInt("FPS LIMITER", &fps, 10, 1000);
+          if (textureStreamer && !textureStreamer->done())
+          {
+              ImGui::Text("Streaming textures...");
+          }
           if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
 
               const auto prev_camera_index = camera_index;
@@ -624,6 +1083,75 @@ int ViewerApplication::run()
               ImGui::RadioButton("Viewspace Position", &render_mode, 9);
           }
 
+          if (ImGui::CollapsingHeader("Scene") && sceneGraph.size() > 0)
+          {
+              ImGui::Text("World matrices updated last frame: %zu / %zu",
+                          updatedNodeCount, sceneGraph.size());
+              ImGui::Checkbox("Frustum culling", &frustum_culling);
+              ImGui::Checkbox("Hierarchical culling", &hierarchical_culling);
+              ImGui::Checkbox("Occlusion culling", &occlusion_culling);
+              if (occlusion_culling)
+              {
+                  ImGui::Text("Occlusion culling: %.3f ms (rasterize %.3f, "
+                              "pyramid %.3f, test %.3f)",
+                              occlusionStats.rasterizeMilliseconds +
+                                  occlusionStats.pyramidMilliseconds +
+                                  occlusionStats.testMilliseconds,
+                              occlusionStats.rasterizeMilliseconds,
+                              occlusionStats.pyramidMilliseconds,
+                              occlusionStats.testMilliseconds);
+                  ImGui::Text("Occluders: %zu (%zu triangles), occluded: %zu",
+                              occlusionStats.occluderCount,
+                              occlusionStats.triangleCount,
+                              occlusionStats.occludedCount);
+              }
+              ImGui::Text("Primitives visible: %zu, culled: %zu",
+                          visiblePrimitiveCount,
+                          primitiveInstances.size() - visiblePrimitiveCount);
+              ImGui::Checkbox("Levels of detail", &lod_enabled);
+              if (lod_enabled)
+              {
+                  ImGui::SliderFloat("max pixel error", &lod_pixel_error, 0.1f, 16.f, "%.1f");
+              }
+              ImGui::Text("Triangles drawn: %zu", drawnTriangleCount);
+              ImGui::Checkbox("Sort draws by state", &sort_draws);
+              ImGui::Checkbox("Instance draws of the same primitive", &gpu_instancing);
+              if (!meshArena.vertices.empty())
+              {
+                  ImGui::Checkbox("Multi-draw indirect", &multi_draw_indirect);
+              }
+              ImGui::Text("Draws: %zu in %zu calls, material binds: %zu, VAO binds: %zu",
+                          drawItems.size(), drawCallCount, materialBindCount,
+                          vertexArrayBindCount);
+              ImGui::Text("GL state calls: %zu issued, %zu elided",
+                          glState.counters().issued, glState.counters().elided);
+              if (ImGui::SliderInt("node", &edited_node, 0, int(sceneGraph.size()) - 1))
+              {
+                  edited_node_translation = glm::vec3(0);
+              }
+              if (ImGui::Button("Pick node at view center"))
+              {
+                  float distance;
+                  const auto instance = raycastPrimitiveInstances(primitiveInstances,
+                      camera.eye(), camera.front(),
+                      std::numeric_limits<float>::max(), distance);
+                  if (instance >= 0)
+                  {
+                      edited_node = primitiveInstances.nodes[instance];
+                      edited_node_translation = glm::vec3(0);
+                  }
+              }
+              // Translate the node, moving its whole subtree
+              auto translation = edited_node_translation;
+              if (ImGui::DragFloat3("translate", &translation.x, 0.01f * maxDistance))
+              {
+                  setLocalMatrix(sceneGraph, edited_node,
+                                 glm::translate(glm::mat4(1), translation - edited_node_translation)
+                                 * sceneGraph.localMatrices[edited_node]);
+                  edited_node_translation = translation;
+              }
+          }
+
           ImGui::End();
       }
 
@@ -651,7 +1179,11 @@ int ViewerApplication::run()
 ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
                                      uint32_t height, const fs::path &gltfFile,
                                      const std::vector<float> &lookatArgs, const std::string &vertexShader,
-                                     const std::string &fragmentShader, const fs::path &output) :
+                                     const std::string &fragmentShader, const fs::path &output,
+                                     const fs::path &sceneCacheDirectory, bool rebuildSceneCache,
+                                     size_t textureUploadBudget, bool gpuResident,
+                                     bool multiDrawIndirect,
+                                     const fs::path &loadReport) :
     m_nWindowWidth(width),
     m_nWindowHeight(height),
     m_AppPath{appPath},
@@ -659,7 +1191,13 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
     m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
     m_gltfFilePath{gltfFile},
-    m_OutputPath{output}
+    m_OutputPath{output},
+    m_sceneCacheDirectory{sceneCacheDirectory},
+    m_rebuildSceneCache{rebuildSceneCache},
+    m_textureUploadBudget{textureUploadBudget},
+    m_gpuResident{gpuResident},
+    m_multiDrawIndirect{multiDrawIndirect},
+    m_loadReportPath{loadReport}
 {
     if (!lookatArgs.empty()) {
         m_hasUserCamera = true;
@@ -689,14 +1227,14 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
 
 
 bool
-ViewerApplication::loadGltfFile(tinygltf::Model & model)
+ViewerApplication::loadGltfFile(tinygltf::Model & model, GltfBuffers & buffers)
 {
-    tinygltf::TinyGLTF loader;
     std::string err;
     std::string warn;
 
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, m_gltfFilePath.string());
-    //bool ret = loader.LoadBinaryFromFile(&model, &err, &warn, m_gltfFilePath.string()); // for binary glTF(.glb)
+    // Handles both .gltf and .glb, buffers are memory-mapped and not copied.
+    // Images are not decoded here, see ImageDecodeQueue
+    bool ret = loadGltf(m_gltfFilePath, model, buffers, err, warn, false);
 
     if (!warn.empty()) {
         printf("Warn: %s\n", warn.c_str());
@@ -716,18 +1254,56 @@ ViewerApplication::loadGltfFile(tinygltf::Model & model)
 
 // checked
 std::vector<GLuint> ViewerApplication::createBufferObjects(
-    const tinygltf::Model &model) const
+    const tinygltf::Model &model, const GltfBuffers &buffers,
+    const CompactBufferLayout &bufferLayout, const LodChains &lods) const
 {
     std::vector<GLuint> bufferObjects(model.buffers.size(), 0); // Assuming buffers is a std::vector of Buffer
     
-    glGenBuffers(model.buffers.size(), bufferObjects.data());
-    
     for (size_t i = 0; i < model.buffers.size(); ++i)
     {
+        if (bufferLayout.bufferSizes[i] == 0)
+        { // Nothing rendered from this buffer
+            continue;
+        }
+        glGenBuffers(1, &bufferObjects[i]);
         glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[i]);
-        glBufferStorage(GL_ARRAY_BUFFER,
-                        model.buffers[i].data.size(), // Assume a Buffer has a data member variable of type std::vector
-                        model.buffers[i].data.data(), 0);
+        glBufferStorage(GL_ARRAY_BUFFER, bufferLayout.bufferSizes[i],
+                        nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    // Each used bufferView straight from the memory-mapped file to its packed
+    // location, no intermediate copy
+    for (size_t i = 0; i < model.bufferViews.size(); ++i)
+    {
+        if (bufferLayout.bufferViewOffsets[i] < 0)
+        {
+            continue;
+        }
+        const auto bytes = getBufferViewBytes(model, buffers, int(i));
+        glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[model.bufferViews[i].buffer]);
+        glBufferSubData(GL_ARRAY_BUFFER, bufferLayout.bufferViewOffsets[i],
+                        bytes.size, bytes.data);
+    }
+
+    // Generated levels of detail, after the indices of their primitive
+    for (size_t meshIdx = 0; meshIdx < lods.meshes.size(); ++meshIdx)
+    {
+        for (size_t primIdx = 0; primIdx < lods.meshes[meshIdx].size(); ++primIdx)
+        {
+            const auto & levels = lods.meshes[meshIdx][primIdx];
+            if (levels.empty())
+            {
+                continue;
+            }
+            const auto & accessor = model.accessors[model.meshes[meshIdx].primitives[primIdx].indices];
+            glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[model.bufferViews[accessor.bufferView].buffer]);
+            for (const auto & level : levels)
+            {
+                glBufferSubData(GL_ARRAY_BUFFER, level.byteOffset,
+                                level.indexCount * sizeof(uint32_t),
+                                lods.indices.data() + level.firstIndex);
+            }
+        }
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0); // Cleanup the binding point after the loop only
 
@@ -741,6 +1317,8 @@ std::vector<GLuint> ViewerApplication::createBufferObjects(
 std::vector<GLuint>
 ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
                                             const std::vector<GLuint> &bufferObjects,
+                                            GLuint instanceBufferObject,
+                                            const CompactBufferLayout &bufferLayout,
                                             std::vector<VaoRange> & meshIndexToVaoRange) const
 {
     std::vector<GLuint> vertexArrayObjects;
@@ -762,15 +1340,7 @@ ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
 
             glBindVertexArray(vao);
 
-            const std::vector<std::pair<std::string, GLuint>> attributes =
-                {
-                    {"POSITION", VERTEX_ATTRIB_POSITION_IDX},
-                    {"NORMAL", VERTEX_ATTRIB_NORMAL_IDX},
-                    {"TEXCOORD_0", VERTEX_ATTRIB_TEXCOORD0_IDX},
-                    {"TANGENT", VERTEX_ATTRIB_TANGENT_IDX},
-                };
-
-            for (const auto name_and_attrib: attributes)
+            for (const auto name_and_attrib: VERTEX_ATTRIBUTES)
             {
                 const auto iterator = primitive.attributes.find(name_and_attrib.first);
                 const auto attrib = name_and_attrib.second;
@@ -788,7 +1358,7 @@ ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
                     //glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
                     
                     glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
-                    const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
+                    const auto byteOffset = bufferLayout.bufferViewOffsets[accessor.bufferView] + accessor.byteOffset;
                     glVertexAttribPointer(attrib,
                                           accessor.type,
                                           accessor.componentType,
@@ -800,6 +1370,8 @@ ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
                                                                                                                                                                                                     
             }
 
+            setInstanceAttributes(instanceBufferObject);
+
             if (primitive.indices >= 0)
             {
                 const auto & accessor = model.accessors[primitive.indices];
@@ -824,7 +1396,9 @@ ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
 
 
 std::vector<GLuint>
-ViewerApplication::createTextureObjects(const tinygltf::Model &model) const
+ViewerApplication::createTextureObjects(const tinygltf::Model &model,
+                                        const GltfBuffers &buffers,
+                                        ImageDecodeQueue &imageDecodeQueue) const
 {
     std::vector<GLuint> textures(model.textures.size(), 0);
     
@@ -840,41 +1414,63 @@ ViewerApplication::createTextureObjects(const tinygltf::Model &model) const
 
     glGenTextures((GLsizei) model.textures.size(), textures.data());
 
-    auto i = 0;
-    for (const auto & tex: model.textures)
+    // Textures using each image, uploaded as soon as the image is decoded
+    std::vector<std::vector<size_t>> imageToTextures(model.images.size());
+    for (size_t i = 0; i < model.textures.size(); ++i)
     {
-        const GLuint & tex_obj = textures[i++];
-        
-        assert(tex.source >= 0);
+        if (model.textures[i].source >= 0)
+        { // Duplicates have no source, see deduplicateResources()
+            imageToTextures[model.textures[i].source].push_back(i);
+        }
+    }
 
-        const auto & image = model.images[tex.source];
+    int imageIdx;
+    while ((imageIdx = imageDecodeQueue.pop()) >= 0)
+    {
+        if (imageToTextures[imageIdx].empty())
+        {
+            continue;
+        }
+        const auto & image = model.images[imageIdx];
+        const auto pixels = getImagePixels(model, buffers, imageIdx);
+        if (!pixels.data)
+        {
+            std::cerr << "Image " << imageIdx << " could not be decoded\n";
+            continue;
+        }
 
-        const auto & sampler = tex.sampler >= 0 ? model.samplers[tex.sampler] : default_sampler;
+        for (const auto texIdx: imageToTextures[imageIdx])
+        {
+            const auto & tex = model.textures[texIdx];
+            const GLuint & tex_obj = textures[texIdx];
 
+            const auto & sampler = tex.sampler >= 0 ? model.samplers[tex.sampler] : default_sampler;
 
-        glBindTexture(GL_TEXTURE_2D, tex_obj);
-        
-        // texture generation
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                     image.width, image.height,
-                     0, GL_RGBA, image.pixel_type,
-                     image.image.data());
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                        sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
-        
-        
-        if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST ||
-            sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ||
-            sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST ||
-            sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR)
-        {
-            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glBindTexture(GL_TEXTURE_2D, tex_obj);
+
+            // texture generation
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                         image.width, image.height,
+                         0, GL_RGBA, image.pixel_type,
+                         pixels.data);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                            sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                            sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
+
+
+            if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST ||
+                sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ||
+                sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+                sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR)
+            {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
         }
 
     }
@@ -2,9 +2,25 @@
 
 #include "utils/GLFWHandle.hpp"
 #include "utils/cameras.hpp"
+#include "utils/culling.hpp"
+#include "utils/lod.hpp"
+#include "utils/materials.hpp"
+#include "utils/mesh_arena.hpp"
+#include "utils/occlusion.hpp"
+#include "utils/render_queue.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/gl_state_cache.hpp"
+#include "utils/gltf.hpp"
+#include "utils/gltf_dedup.hpp"
+#include "utils/gltf_loader.hpp"
+#include "utils/image_decoder.hpp"
 #include "utils/shaders.hpp"
+#include "utils/texture_streamer.hpp"
 #include "utils/images.hpp"
+#include "utils/load_report.hpp"
+#include "utils/scene_cache.hpp"
+#include "utils/scene_graph.hpp"
+#include "utils/thread_pool.hpp"
 
 #include <tiny_gltf.h>
 
@@ -14,7 +30,9 @@ public:
   ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height,
       const fs::path &gltfFile, const std::vector<float> &lookatArgs,
       const std::string &vertexShader, const std::string &fragmentShader,
-      const fs::path &output);
+      const fs::path &output, const fs::path &sceneCacheDirectory,
+      bool rebuildSceneCache, size_t textureUploadBudget, bool gpuResident,
+      bool multiDrawIndirect, const fs::path &loadReport);
 
   int run();
 
@@ -44,6 +62,26 @@ private:
 
   fs::path m_OutputPath;
 
+  // Scene cache disabled if empty
+  fs::path m_sceneCacheDirectory;
+  bool m_rebuildSceneCache = false;
+
+  // Bytes of texels uploaded per frame when streaming textures, 0 to upload
+  // every texture before the first frame
+  size_t m_textureUploadBudget = 0;
+
+  // Release the CPU copies of buffers and images once uploaded
+  bool m_gpuResident = false;
+
+  // Build a MeshArena at load to draw with glMultiDrawElementsIndirect
+  bool m_multiDrawIndirect = false;
+
+  // JSON report of the loading stages, not written if empty
+  fs::path m_loadReportPath;
+
+  // Workers for load-time tasks, e.g. image decoding
+  ThreadPool m_threadPool;
+
   // Order is important here, see comment below
   const std::string m_ImGuiIniFilename;
   // Last to be initialized, first to be destroyed:
@@ -65,17 +103,25 @@ private:
   */
 
 
-    bool loadGltfFile(tinygltf::Model & model);
+    bool loadGltfFile(tinygltf::Model & model, GltfBuffers & buffers);
 
     std::vector<GLuint>
-    createBufferObjects(const tinygltf::Model &model) const;
+    createBufferObjects(const tinygltf::Model &model,
+                        const GltfBuffers &buffers,
+                        const CompactBufferLayout &bufferLayout,
+                        const LodChains &lods) const;
 
     std::vector<GLuint>
     createVertexArrayObjects(const tinygltf::Model &model,
                              const std::vector<GLuint> &bufferObjects,
+                             GLuint instanceBufferObject,
+                             const CompactBufferLayout &bufferLayout,
                              std::vector<VaoRange> & meshIndexToVaoRange) const;
 
+    // Upload the images popped from imageDecodeQueue as they are decoded
     std::vector<GLuint>
-    createTextureObjects(const tinygltf::Model & model) const;
+    createTextureObjects(const tinygltf::Model & model,
+                         const GltfBuffers & buffers,
+                         ImageDecodeQueue & imageDecodeQueue) const;
     
 };
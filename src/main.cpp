@@ -1,9 +1,12 @@
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
+#include "utils/benchmarks.hpp"
 #include "utils/filesystem.hpp"
 
 #include <args.hxx>
 
+#include <algorithm>
+
 std::vector<std::string> split(
     const std::string &str, const std::string &delim);
 
@@ -21,6 +24,22 @@ int main(int argc, char **argv)
         GLFWHandle handle{1, 1, "", false};
         printGLVersion();
       }};
+  args::Command benchBase64{commands, "bench-base64",
+      "Benchmark the decoding of base64 data URIs",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<size_t> size{parser, "MiB",
+            "Size of the decoded data (default 64)", {"size"}, 64};
+        parser.Parse();
+        returnCode = benchmarkBase64(args::get(size));
+      }};
+  args::Command benchOcclusion{commands, "bench-occlusion",
+      "Benchmark the software occlusion culling",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<size_t> boxes{parser, "count",
+            "Number of boxes tested (default 100000)", {"boxes"}, 100000};
+        parser.Parse();
+        returnCode = benchmarkOcclusion(args::get(boxes));
+      }};
   args::Command interactive{
       commands, "viewer", "Run glTF viewer", [&](args::Subparser &parser) {
         args::Positional<std::string> file{
@@ -43,6 +62,33 @@ int main(int argc, char **argv)
             "Output path to render the image. If specified no window is shown. "
             "Only png is supported.",
             {"o", "output"}};
+        args::ValueFlag<std::string> sceneCache{parser, "dir",
+            "Directory of the scene cache. Loaded scenes are stored there in "
+            "a binary form that is much faster to load next time.",
+            {"cache-dir"}};
+        args::Flag rebuildSceneCache{parser, "rebuild-cache",
+            "Invalidate the scene cache entry of the file and rebuild it",
+            {"rebuild-cache"}};
+        args::Flag streamTextures{parser, "stream-textures",
+            "Start rendering before textures are loaded, with placeholders, "
+            "then upload them progressively",
+            {"stream-textures"}};
+        args::ValueFlag<size_t> textureUploadBudget{parser, "bytes",
+            "Bytes of texels uploaded per frame with --stream-textures "
+            "(default 4 MiB)",
+            {"texture-budget"}, size_t(4) << 20};
+        args::Flag gpuResident{parser, "gpu-resident",
+            "Free the CPU copies of buffers and images once uploaded to the "
+            "GPU, to lower memory usage",
+            {"gpu-resident"}};
+        args::Flag multiDrawIndirect{parser, "multi-draw-indirect",
+            "Also pack the triangle primitives in shared vertex and index "
+            "buffers, to submit them with one multi-draw per texture set",
+            {"multi-draw-indirect"}};
+        args::ValueFlag<std::string> loadReport{parser, "json",
+            "Write the time, bytes processed and allocations of each loading "
+            "stage to this JSON file",
+            {"load-report"}};
         parser.Parse();
 
         std::vector<float> lookatParams;
@@ -64,7 +110,12 @@ int main(int argc, char **argv)
 
         ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file),
             lookatParams, args::get(vertexShader), args::get(fragmentShader),
-            args::get(output)};
+            args::get(output), args::get(sceneCache),
+            args::get(rebuildSceneCache),
+            streamTextures ? std::max(size_t(1), args::get(textureUploadBudget))
+                           : 0,
+            args::get(gpuResident), args::get(multiDrawIndirect),
+            args::get(loadReport)};
         returnCode = app.run();
       }};
 
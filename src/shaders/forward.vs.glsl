@@ -4,29 +4,38 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 layout(location = 3) in vec3 aTangent;
+// Per instance
+layout(location = 4) in mat4 aModelMatrix;
+layout(location = 8) in mat3 aNormalMatrix;
+layout(location = 11) in int aMaterialTexel;
 
 out vec3 vWorldSpacePosition;
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
 out vec2 vTexCoords;
 out mat3 vTBN;
+flat out int vMaterialTexel;
 
-uniform mat4 uModelViewProjMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uModelMatrix;
-uniform mat4 uNormalMatrix;
+uniform mat4 uViewMatrix;
+uniform mat4 uProjMatrix;
 
 void main()
 {
-    vec3 T = normalize(vec3(uModelViewMatrix * vec4(aTangent,   0.0)));
-    vec3 N = normalize(vec3(uModelViewMatrix * vec4(aNormal,    0.0)));
+    mat4 modelViewMatrix = uViewMatrix * aModelMatrix;
+    // The view matrix is a rigid transformation, its own inverse-transpose
+    mat3 normalMatrix = mat3(uViewMatrix) * aNormalMatrix;
+
+    vec3 T = normalize(vec3(modelViewMatrix * vec4(aTangent,   0.0)));
+    vec3 N = normalize(vec3(modelViewMatrix * vec4(aNormal,    0.0)));
     vec3 B = cross(N, T);
 
     vTBN = mat3(T, B, N);
     
-    vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-    vWorldSpacePosition = vec3(uModelMatrix * vec4(aPosition, 1));
-    vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+    vec4 worldPosition = aModelMatrix * vec4(aPosition, 1);
+    vViewSpacePosition = vec3(uViewMatrix * worldPosition);
+    vWorldSpacePosition = vec3(worldPosition);
+    vViewSpaceNormal = normalize(normalMatrix * aNormal);
 	vTexCoords = aTexCoords;
-    gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
+    vMaterialTexel = aMaterialTexel;
+    gl_Position =  uProjMatrix * vec4(vViewSpacePosition, 1);
 }
@@ -5,22 +5,57 @@ in vec2 vTexCoords;
 in vec3 vViewSpacePosition;
 in vec3 vWorldSpacePosition;
 in mat3 vTBN;
+flat in int vMaterialTexel;
 
 uniform vec3 uLightDir;
 uniform vec3 uLightCol;
 
-uniform sampler2D uBaseColorTexture;
+// Factors of the current material: the range of the material buffer bound to
+// this block (MaterialData on the CPU side)
+layout(std140) uniform Material
+{
+  vec4 uBaseColorFactor;
+  vec3 uEmissiveFactor;
+  float uMetallicFactor;
+  float uRoughnessFactor;
+  float uOcclusionStrength;
+};
+
+// Factors of every material, the material buffer seen as texels: read at
+// vMaterialTexel instead of the Material block when uIndexedMaterials is set,
+// for the draws merged by multi-draw indirect
+uniform samplerBuffer uMaterials;
+uniform int uIndexedMaterials;
+
+struct MaterialFactors
+{
+  vec4 baseColor;
+  vec3 emissive;
+  float metallic;
+  float roughness;
+  float occlusionStrength;
+};
+
+MaterialFactors getMaterialFactors()
+{
+  if (uIndexedMaterials == 0) {
+    return MaterialFactors(uBaseColorFactor, uEmissiveFactor, uMetallicFactor,
+        uRoughnessFactor, uOcclusionStrength);
+  }
+  // Same std140 layout as the block
+  vec4 texel1 = texelFetch(uMaterials, vMaterialTexel + 1);
+  vec4 texel2 = texelFetch(uMaterials, vMaterialTexel + 2);
+  return MaterialFactors(texelFetch(uMaterials, vMaterialTexel), texel1.xyz,
+      texel1.w, texel2.x, texel2.y);
+}
 
-uniform vec4 uBaseColorFactor;
+uniform sampler2D uBaseColorTexture;
 
-uniform float uMetallicFactor;
-uniform float uRoughnessFactor;
 uniform sampler2D uMetallicRoughnessTexture;
 
-uniform vec3 uEmissiveFactor;
 uniform sampler2D uEmissiveTexture;
 
-uniform float uOcclusionFactor;
+uniform int uApplyOcclusion;
 uniform sampler2D uOcclusionTexture;
 
 uniform sampler2D uNormalTexture;
@@ -159,6 +194,7 @@ vec3 perturb_normal( vec3 N, vec3 V, vec2 texcoord )
 
 void main()
 {
+  MaterialFactors factors = getMaterialFactors();
   vec3 N = normalize(vViewSpaceNormal);
   vec3 L = uLightDir;
   vec3 V = normalize(-vViewSpacePosition);
@@ -178,11 +214,11 @@ void main()
 
   vec4 baseColorFromTexture = 
       SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
-  vec4 baseColor = baseColorFromTexture * uBaseColorFactor;
+  vec4 baseColor = baseColorFromTexture * factors.baseColor;
 
 
-  float roughness = baseRoughness*uRoughnessFactor;
-  float metallic = baseMetallic*uMetallicFactor;
+  float roughness = baseRoughness*factors.roughness;
+  float metallic = baseMetallic*factors.metallic;
   
   float alpha = roughness*roughness;
   float alpha2 = alpha*alpha;
@@ -227,14 +263,15 @@ void main()
 
   vec3 material = f_diffuse + f_specular;
 
-  vec3 emission = texture(uEmissiveTexture, vTexCoords).rgb*uEmissiveFactor;
+  vec3 emission = texture(uEmissiveTexture, vTexCoords).rgb*factors.emissive;
   
   vec3 color = (f_diffuse + f_specular) * uLightCol * NdotL + emission;
 
-  if (uOcclusionFactor > 0)
+  float occlusionFactor = uApplyOcclusion != 0 ? factors.occlusionStrength : 0.0;
+  if (occlusionFactor > 0)
   {
       float occl = texture2D(uOcclusionTexture, vTexCoords).r;
-      color = mix(color, color * occl, uOcclusionFactor);
+      color = mix(color, color * occl, occlusionFactor);
   }
 
   if (uRenderMode == MODE_STANDARD)
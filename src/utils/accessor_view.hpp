@@ -0,0 +1,222 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Typed view of the count elements of an accessor, byteStride bytes apart.
+// Elements are read with memcpy: the data needs no alignment.
+template <typename T> class AccessorView
+{
+public:
+  using value_type = T;
+
+  AccessorView() = default;
+  AccessorView(const unsigned char *data, size_t count, size_t byteStride) :
+      m_data(data), m_count(count), m_byteStride(byteStride)
+  {
+  }
+
+  size_t size() const { return m_count; }
+  bool empty() const { return m_count == 0; }
+  const unsigned char *data() const { return m_data; }
+  size_t byteStride() const { return m_byteStride; }
+  bool isPacked() const { return m_byteStride == sizeof(T); }
+
+  T operator[](size_t i) const
+  {
+    T value;
+    std::memcpy(&value, m_data + i * m_byteStride, sizeof(T));
+    return value;
+  }
+
+private:
+  const unsigned char *m_data = nullptr;
+  size_t m_count = 0;
+  size_t m_byteStride = sizeof(T);
+};
+
+// Index accessors are scalars of unsigned bytes, shorts or ints
+template <typename T> using IndexView = AccessorView<T>;
+
+// glTF component type of the C++ type of a component
+template <typename T> struct ComponentTraits;
+template <> struct ComponentTraits<int8_t>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_BYTE;
+};
+template <> struct ComponentTraits<uint8_t>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+};
+template <> struct ComponentTraits<int16_t>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_SHORT;
+};
+template <> struct ComponentTraits<uint16_t>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+};
+template <> struct ComponentTraits<uint32_t>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+};
+template <> struct ComponentTraits<float>
+{
+  static const int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+};
+
+// glTF type and component of the C++ type of an element: scalars or glm
+// vectors
+template <typename T> struct ElementTraits
+{
+  using Component = T;
+  static const int type = TINYGLTF_TYPE_SCALAR;
+};
+template <glm::length_t N, typename T, glm::qualifier Q>
+struct ElementTraits<glm::vec<N, T, Q>>
+{
+  using Component = T;
+  static const int type = N == 2   ? TINYGLTF_TYPE_VEC2
+                          : N == 3 ? TINYGLTF_TYPE_VEC3
+                                   : TINYGLTF_TYPE_VEC4;
+};
+
+// View of the elements of accessor as T, empty if the type or the component
+// type of accessor are not the ones of T, or if it has no bufferView
+template <typename T>
+AccessorView<T> makeAccessorView(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  using Traits = ElementTraits<T>;
+  if (accessor.type != Traits::type ||
+      accessor.componentType !=
+          ComponentTraits<typename Traits::Component>::componentType ||
+      accessor.bufferView < 0) {
+    return {};
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto bytes = getBufferViewBytes(model, buffers, accessor.bufferView);
+  return {bytes.data + accessor.byteOffset, accessor.count,
+      size_t(accessor.ByteStride(bufferView))};
+}
+
+// Factor from the components of accessor to their float value: 1 unless they
+// are normalized integers
+inline float getNormalizationScale(const tinygltf::Accessor &accessor)
+{
+  if (!accessor.normalized) {
+    return 1.f;
+  }
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return 1.f / 127.f;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return 1.f / 255.f;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    return 1.f / 32767.f;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return 1.f / 65535.f;
+  }
+  return 1.f;
+}
+
+// Call f(i, view[i]) for each element of view. Packed elements, the common
+// case, are read at a constant stride so that the loop can be vectorized.
+template <typename T, typename Function>
+void forEachElement(const AccessorView<T> &view, Function &&f)
+{
+  const auto *data = view.data();
+  if (view.isPacked()) {
+    for (size_t i = 0; i < view.size(); ++i) {
+      T value;
+      std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+      f(i, value);
+    }
+  } else {
+    for (size_t i = 0; i < view.size(); ++i) {
+      f(i, view[i]);
+    }
+  }
+}
+
+// Call f(view) once with the IndexView of the component type of accessor.
+// Return false without calling f if it is not an index accessor.
+template <typename Function>
+bool visitIndexView(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&f)
+{
+  if (accessor.type != TINYGLTF_TYPE_SCALAR || accessor.bufferView < 0) {
+    return false;
+  }
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    f(makeAccessorView<uint8_t>(model, buffers, accessor));
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    f(makeAccessorView<uint16_t>(model, buffers, accessor));
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    f(makeAccessorView<uint32_t>(model, buffers, accessor));
+    return true;
+  }
+  return false;
+}
+
+// Call f(view, scale) once with the AccessorView of glm::vec<N, C>, C being
+// the component type of accessor, scale its getNormalizationScale(). Return
+// false without calling f if accessor is not a vector of N components of a
+// vertex attribute type (floats, or bytes and shorts as allowed by
+// KHR_mesh_quantization).
+template <glm::length_t N, typename Function>
+bool visitVectorView(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&f)
+{
+  if (accessor.type != ElementTraits<glm::vec<N, float>>::type ||
+      accessor.bufferView < 0) {
+    return false;
+  }
+  const auto scale = getNormalizationScale(accessor);
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    f(makeAccessorView<glm::vec<N, float>>(model, buffers, accessor), scale);
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    f(makeAccessorView<glm::vec<N, int8_t>>(model, buffers, accessor), scale);
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    f(makeAccessorView<glm::vec<N, uint8_t>>(model, buffers, accessor), scale);
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    f(makeAccessorView<glm::vec<N, int16_t>>(model, buffers, accessor), scale);
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    f(makeAccessorView<glm::vec<N, uint16_t>>(model, buffers, accessor),
+        scale);
+    return true;
+  }
+  return false;
+}
+
+// Vectors of N components of an accessor of floats or of (normalized)
+// integers, as floats, empty for other accessors
+template <glm::length_t N>
+std::vector<glm::vec<N, float>> readVectors(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  std::vector<glm::vec<N, float>> vectors;
+  visitVectorView<N>(
+      model, buffers, accessor, [&](const auto &view, float scale) {
+        vectors.resize(view.size());
+        forEachElement(view, [&](size_t i, const auto &vector) {
+          vectors[i] = glm::vec<N, float>(vector) * scale;
+        });
+      });
+  return vectors;
+}
@@ -0,0 +1,65 @@
+#include "allocation_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+// Thread local so that counting needs no synchronization
+thread_local size_t allocationCount = 0;
+thread_local size_t allocatedBytes = 0;
+
+} // namespace
+
+AllocationCounters getThreadAllocationCounters()
+{
+  return AllocationCounters{allocationCount, allocatedBytes};
+}
+
+void *operator new(std::size_t size)
+{
+  ++allocationCount;
+  allocatedBytes += size;
+  for (;;) {
+    if (auto *p = std::malloc(size ? size : 1)) {
+      return p;
+    }
+    const auto handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  try {
+    return operator new(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
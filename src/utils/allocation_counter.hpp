@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Allocations made with operator new by the calling thread since it started.
+// The global operator new is replaced (see allocation_counter.cpp) to count
+// them; allocations made with malloc (stb_image, ImGui...) are not counted.
+struct AllocationCounters
+{
+  size_t count = 0;
+  size_t bytes = 0;
+};
+
+AllocationCounters getThreadAllocationCounters();
+
+inline AllocationCounters operator-(
+    const AllocationCounters &lhs, const AllocationCounters &rhs)
+{
+  return AllocationCounters{lhs.count - rhs.count, lhs.bytes - rhs.bytes};
+}
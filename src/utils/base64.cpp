@@ -0,0 +1,304 @@
+#include "base64.hpp"
+
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86 1
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define BASE64_X86 1
+#define BASE64_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace
+{
+
+const char *const ALPHABET =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const unsigned char INVALID = 0xFF;
+
+// 6 bits value of each character, INVALID outside of the alphabet
+struct DecodeTable
+{
+  unsigned char values[256];
+
+  DecodeTable()
+  {
+    for (auto &value : values) {
+      value = INVALID;
+    }
+    for (unsigned char i = 0; i < 64; ++i) {
+      values[(unsigned char)ALPHABET[i]] = i;
+    }
+  }
+};
+
+const DecodeTable DECODE_TABLE;
+
+// '=' padding is optional: only the characters before it matter
+size_t stripPadding(const char *src, size_t size)
+{
+  for (auto i = 0; i < 2 && size > 0 && src[size - 1] == '='; ++i) {
+    --size;
+  }
+  return size;
+}
+
+// Decode characters without padding, 4 at a time
+bool decodeScalar(const char *src, size_t size, unsigned char *dst)
+{
+  const auto *table = DECODE_TABLE.values;
+  const auto decode = [&](size_t i) {
+    return uint32_t(table[uint8_t(src[i])]);
+  };
+
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const auto a = decode(i), b = decode(i + 1), c = decode(i + 2),
+               d = decode(i + 3);
+    if ((a | b | c | d) & 0x80) {
+      return false;
+    }
+    const auto bits = (a << 18) | (b << 12) | (c << 6) | d;
+    *dst++ = uint8_t(bits >> 16);
+    *dst++ = uint8_t(bits >> 8);
+    *dst++ = uint8_t(bits);
+  }
+
+  const auto rest = size - i;
+  if (rest == 1) {
+    return false;
+  }
+  if (rest > 1) {
+    const auto a = decode(i), b = decode(i + 1),
+               c = rest == 3 ? decode(i + 2) : 0;
+    if ((a | b | c) & 0x80) {
+      return false;
+    }
+    const auto bits = (a << 18) | (b << 12) | (c << 6);
+    *dst++ = uint8_t(bits >> 16);
+    if (rest == 3) {
+      *dst++ = uint8_t(bits >> 8);
+    }
+  }
+  return true;
+}
+
+#ifdef BASE64_X86
+
+// Vectorized decoding after W. Mula and D. Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions": characters are validated and translated
+// to their 6 bits value with nibble lookups (pshufb), then packed with
+// multiply-adds. Each function decodes as many blocks as it can without
+// writing past the output, advances src / dst and returns false on an invalid
+// character.
+
+BASE64_TARGET("sse4.1")
+bool decodeSse41(const char *&src, size_t &size, unsigned char *&dst)
+{
+  // Translation of a character c, with hi / lo its high / low nibbles:
+  // c is valid if lutLo[lo] & lutHi[hi] == 0, its value is c + lutRoll[hi]
+  // ('/' is the only character needing another offset than its neighbours)
+  const auto lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const auto lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04,
+      0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const auto lutRoll = _mm_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const auto nibbleMask = _mm_set1_epi8(0x0F);
+  const auto slash = _mm_set1_epi8('/');
+  const auto packShuffle =
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  // 16 characters give 12 bytes but 16 are written: 8 more characters are
+  // needed for the extra 4 bytes to be overwritten later
+  while (size >= 24) {
+    const auto in = _mm_loadu_si128((const __m128i *)src);
+    const auto hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibbleMask);
+    const auto loNibbles = _mm_and_si128(in, nibbleMask);
+    if (!_mm_testz_si128(_mm_shuffle_epi8(lutLo, loNibbles),
+            _mm_shuffle_epi8(lutHi, hiNibbles))) {
+      return false;
+    }
+    const auto roll = _mm_shuffle_epi8(
+        lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(in, slash), hiNibbles));
+    const auto values = _mm_add_epi8(in, roll);
+
+    // 4 x 6 bits -> 24 bits per 32 bits lane, then 3 bytes per lane
+    const auto pairs =
+        _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const auto lanes = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(lanes, packShuffle));
+
+    src += 16;
+    size -= 16;
+    dst += 12;
+  }
+  return true;
+}
+
+BASE64_TARGET("avx2")
+bool decodeAvx2(const char *&src, size_t &size, unsigned char *&dst)
+{
+  // Same as decodeSse41(), 32 characters at a time
+  const auto lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11,
+      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B,
+      0x1B, 0x1A);
+  const auto lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+      0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10);
+  const auto lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+      0, 0);
+  const auto nibbleMask = _mm256_set1_epi8(0x0F);
+  const auto slash = _mm256_set1_epi8('/');
+  const auto packShuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+      13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+      -1, -1);
+  // The 12 bytes of each 128 bits lane end up contiguous
+  const auto packLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+  // 32 characters give 24 bytes but 32 are written
+  while (size >= 48) {
+    const auto in = _mm256_loadu_si256((const __m256i *)src);
+    const auto hiNibbles =
+        _mm256_and_si256(_mm256_srli_epi32(in, 4), nibbleMask);
+    const auto loNibbles = _mm256_and_si256(in, nibbleMask);
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(lutLo, loNibbles),
+            _mm256_shuffle_epi8(lutHi, hiNibbles))) {
+      return false;
+    }
+    const auto roll = _mm256_shuffle_epi8(
+        lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, slash), hiNibbles));
+    const auto values = _mm256_add_epi8(in, roll);
+
+    const auto pairs =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const auto lanes =
+        _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    const auto packed = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(lanes, packShuffle), packLanes);
+    _mm256_storeu_si256((__m256i *)dst, packed);
+
+    src += 32;
+    size -= 32;
+    dst += 24;
+  }
+  return true;
+}
+
+enum class SimdLevel
+{
+  None,
+  Sse41,
+  Avx2
+};
+
+SimdLevel detectSimdLevel()
+{
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::Avx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::Sse41;
+  }
+#else
+  int info[4];
+  __cpuid(info, 0);
+  const auto maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool hasSse41 = (info[2] & (1 << 19)) != 0;
+  const bool hasOsAvx = (info[2] & (1 << 27)) != 0 && // OSXSAVE
+                        (_xgetbv(0) & 6) == 6; // XMM and YMM state
+  if (maxLeaf >= 7 && hasOsAvx) {
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5)) {
+      return SimdLevel::Avx2;
+    }
+  }
+  if (hasSse41) {
+    return SimdLevel::Sse41;
+  }
+#endif
+  return SimdLevel::None;
+}
+
+const SimdLevel SIMD_LEVEL = detectSimdLevel();
+
+#endif
+
+} // namespace
+
+size_t getBase64DecodedSize(const char *src, size_t size)
+{
+  size = stripPadding(src, size);
+  const auto rest = size % 4;
+  return size / 4 * 3 + (rest > 1 ? rest - 1 : 0);
+}
+
+bool decodeBase64(const char *src, size_t size, unsigned char *dst)
+{
+  size = stripPadding(src, size);
+#ifdef BASE64_X86
+  if (SIMD_LEVEL == SimdLevel::Avx2 && !decodeAvx2(src, size, dst)) {
+    return false;
+  }
+  if (SIMD_LEVEL != SimdLevel::None && !decodeSse41(src, size, dst)) {
+    return false;
+  }
+#endif
+  return decodeScalar(src, size, dst);
+}
+
+bool decodeBase64Scalar(const char *src, size_t size, unsigned char *dst)
+{
+  return decodeScalar(src, stripPadding(src, size), dst);
+}
+
+const char *getBase64DecoderName()
+{
+#ifdef BASE64_X86
+  switch (SIMD_LEVEL) {
+  case SimdLevel::Avx2:
+    return "avx2";
+  case SimdLevel::Sse41:
+    return "sse4.1";
+  default:
+    break;
+  }
+#endif
+  return "scalar";
+}
+
+std::string encodeBase64(const unsigned char *src, size_t size)
+{
+  std::string encoded;
+  encoded.reserve((size + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3) {
+    const auto bits = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) |
+                      src[i + 2];
+    encoded += ALPHABET[(bits >> 18) & 63];
+    encoded += ALPHABET[(bits >> 12) & 63];
+    encoded += ALPHABET[(bits >> 6) & 63];
+    encoded += ALPHABET[bits & 63];
+  }
+  if (i < size) {
+    const auto hasTwo = i + 1 < size;
+    const auto bits =
+        (uint32_t(src[i]) << 16) | (hasTwo ? uint32_t(src[i + 1]) << 8 : 0);
+    encoded += ALPHABET[(bits >> 18) & 63];
+    encoded += ALPHABET[(bits >> 12) & 63];
+    encoded += hasTwo ? ALPHABET[(bits >> 6) & 63] : '=';
+    encoded += '=';
+  }
+  return encoded;
+}
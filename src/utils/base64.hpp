@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Base64 (standard alphabet, RFC 4648) decoding of the data URIs of glTF
+// files. decodeBase64() processes 32 characters per iteration with AVX2, or
+// 16 with SSE4.1, when the CPU supports them; the scalar version is the
+// fallback.
+
+// Number of bytes encoded by size characters of base64, '=' padding excluded
+size_t getBase64DecodedSize(const char *src, size_t size);
+
+// Decode size characters of base64 into dst, which must hold
+// getBase64DecodedSize(src, size) bytes. Padding is optional. Return false if
+// src holds any character outside of the alphabet.
+bool decodeBase64(const char *src, size_t size, unsigned char *dst);
+
+// Same as decodeBase64() without SIMD instructions
+bool decodeBase64Scalar(const char *src, size_t size, unsigned char *dst);
+
+// Name of the implementation used by decodeBase64(): "avx2", "sse4.1" or
+// "scalar"
+const char *getBase64DecoderName();
+
+std::string encodeBase64(const unsigned char *src, size_t size);
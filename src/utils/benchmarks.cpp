@@ -0,0 +1,156 @@
+#include "benchmarks.hpp"
+#include "base64.hpp"
+#include "occlusion.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// Best wall time of a few runs, in seconds
+double measure(const std::function<void()> &run)
+{
+  auto best = std::numeric_limits<double>::max();
+  for (int i = 0; i < 5; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  return best;
+}
+
+} // namespace
+
+int benchmarkBase64(size_t megabytes)
+{
+  const auto size = std::max(size_t(1), megabytes) << 20;
+  std::vector<unsigned char> data(size);
+  std::mt19937 generator;
+  for (auto &byte : data) {
+    byte = (unsigned char)generator();
+  }
+  const auto uri = "data:application/octet-stream;base64," +
+                   encodeBase64(data.data(), data.size());
+  const auto *src = uri.data() + uri.find(',') + 1;
+  const auto srcSize = uri.size() - (src - uri.data());
+
+  auto success = true;
+  const auto report = [&](const char *name,
+                          const std::vector<unsigned char> &decoded,
+                          double seconds) {
+    const auto valid = decoded.size() == data.size() &&
+                       std::memcmp(decoded.data(), data.data(), size) == 0;
+    success = success && valid;
+    std::printf("%-28s %8.2f ms %9.1f MiB/s%s\n", name, seconds * 1000,
+        double(srcSize) / (1 << 20) / seconds, valid ? "" : " WRONG RESULT");
+  };
+
+  std::printf("Decoding %zu MiB from a %zu MiB data URI\n", size >> 20,
+      srcSize >> 20);
+
+  std::vector<unsigned char> decoded;
+  std::string mimeType;
+  report("tinygltf::DecodeDataURI", decoded, measure([&]() {
+    decoded.clear();
+    tinygltf::DecodeDataURI(&decoded, mimeType, uri, size, true);
+  }));
+
+  decoded.assign(size, 0);
+  report("decodeBase64Scalar", decoded,
+      measure([&]() { decodeBase64Scalar(src, srcSize, decoded.data()); }));
+
+  std::fill(begin(decoded), end(decoded), 0);
+  const auto name =
+      std::string("decodeBase64 (") + getBase64DecoderName() + ")";
+  report(name.c_str(), decoded,
+      measure([&]() { decodeBase64(src, srcSize, decoded.data()); }));
+
+  return success ? 0 : 1;
+}
+
+int benchmarkOcclusion(size_t boxCount)
+{
+  // Camera at the origin looking down -z at a wall of 64x64 quads at z = -20,
+  // larger than the view
+  const auto viewProjMatrix =
+      glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 1000.f);
+  const auto wallDistance = 20.f;
+  const int quadCount = 64;
+  OccluderMesh wall;
+  for (int y = 0; y <= quadCount; ++y) {
+    for (int x = 0; x <= quadCount; ++x) {
+      wall.positions.emplace_back(-40.f + 80.f * x / quadCount,
+          -25.f + 50.f * y / quadCount, -wallDistance);
+    }
+  }
+  for (int y = 0; y < quadCount; ++y) {
+    for (int x = 0; x < quadCount; ++x) {
+      const auto corner = uint32_t(y * (quadCount + 1) + x);
+      const uint32_t row = quadCount + 1;
+      for (const auto index : {corner, corner + 1, corner + row + 1, corner,
+               corner + row + 1, corner + row}) {
+        wall.indices.push_back(index);
+      }
+    }
+  }
+
+  // Half of the boxes in front of the wall, half behind it, all in the view
+  std::vector<Bounds> boxes(std::max(size_t(2), boxCount));
+  std::mt19937 generator;
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    const auto z = i % 2 ? -wallDistance * (3.f + 1.4f * unit(generator))
+                         : -wallDistance * (0.5f + 0.4f * unit(generator));
+    const auto center = glm::vec3(-z * 0.9f * unit(generator),
+        -z * 0.5f * unit(generator), z);
+    boxes[i] = {center - 0.25f, center + 0.25f};
+  }
+
+  ThreadPool pool;
+  OcclusionBuffer buffer(pool, 256, 144);
+  std::printf("Occlusion buffer of %dx%d pixels\n", buffer.width(),
+      buffer.height());
+  const auto rasterizeSeconds = measure([&]() {
+    buffer.clear();
+    buffer.addOccluder(wall.positions, wall.indices, viewProjMatrix);
+    buffer.rasterize();
+  });
+  std::printf("%-28s %8.3f ms for %zu triangles\n", "rasterize",
+      rasterizeSeconds * 1000, buffer.triangleCount());
+  const auto pyramidSeconds = measure([&]() { buffer.buildPyramid(); });
+  std::printf("%-28s %8.3f ms\n", "buildPyramid", pyramidSeconds * 1000);
+
+  size_t occludedInFront = 0, occludedBehind = 0;
+  const auto testSeconds = measure([&]() {
+    occludedInFront = occludedBehind = 0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+      if (!buffer.isVisible(boxes[i], viewProjMatrix)) {
+        ++(i % 2 ? occludedBehind : occludedInFront);
+      }
+    }
+  });
+  std::printf("%-28s %8.3f ms for %zu boxes\n", "isVisible",
+      testSeconds * 1000, boxes.size());
+  std::printf("Occluded: %zu / %zu behind the wall, %zu / %zu in front of it\n",
+      occludedBehind, boxes.size() / 2, occludedInFront,
+      (boxes.size() + 1) / 2);
+
+  // Every box behind the wall is hidden, none of those in front of it
+  const auto success =
+      occludedInFront == 0 && occludedBehind == boxes.size() / 2;
+  if (!success) {
+    std::printf("WRONG RESULT\n");
+  }
+  return success ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Microbenchmarks of the loading and culling code, run with the bench-*
+// commands.
+// They print their results and return a process exit code.
+
+// Decode a data URI of megabytes MiB with tinygltf::DecodeDataURI, then with
+// decodeBase64Scalar() and decodeBase64()
+int benchmarkBase64(size_t megabytes);
+
+// Rasterize a wall of occluders into an OcclusionBuffer, then test boxCount
+// random boxes in front of it and behind it against its depth pyramid
+int benchmarkOcclusion(size_t boxCount);
@@ -0,0 +1,67 @@
+#include "bounds.hpp"
+
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_SSE 1
+#include <emmintrin.h>
+#endif
+
+Bounds transformBounds(const Bounds &box, const glm::mat4 &matrix)
+{
+  if (box.empty()) {
+    return box;
+  }
+  const auto center = (box.min + box.max) * 0.5f;
+  const auto halfExtent = (box.max - box.min) * 0.5f;
+  const auto transformedCenter = glm::vec3(matrix * glm::vec4(center, 1.f));
+  glm::vec3 transformedHalfExtent(0);
+  for (int column = 0; column < 3; ++column) {
+    transformedHalfExtent +=
+        glm::abs(glm::vec3(matrix[column])) * halfExtent[column];
+  }
+  Bounds bounds;
+  bounds.min = transformedCenter - transformedHalfExtent;
+  bounds.max = transformedCenter + transformedHalfExtent;
+  return bounds;
+}
+
+Bounds computePositionBounds(
+    const unsigned char *data, size_t count, size_t byteStride)
+{
+  Bounds bounds;
+  size_t i = 0;
+#ifdef BOUNDS_SSE
+  // One unaligned 4 floats load per position, the 4th lane being ignored: it
+  // lies in the next position, so the last one is read separately
+  if (count > 1) {
+    auto min0 = _mm_set1_ps(std::numeric_limits<float>::max());
+    auto max0 = _mm_set1_ps(std::numeric_limits<float>::lowest());
+    auto min1 = min0, max1 = max0;
+    for (; i + 2 < count; i += 2) {
+      const auto p0 = _mm_loadu_ps(
+          reinterpret_cast<const float *>(data + i * byteStride));
+      const auto p1 = _mm_loadu_ps(
+          reinterpret_cast<const float *>(data + (i + 1) * byteStride));
+      min0 = _mm_min_ps(min0, p0);
+      max0 = _mm_max_ps(max0, p0);
+      min1 = _mm_min_ps(min1, p1);
+      max1 = _mm_max_ps(max1, p1);
+    }
+    float min[4], max[4];
+    _mm_storeu_ps(min, _mm_min_ps(min0, min1));
+    _mm_storeu_ps(max, _mm_max_ps(max0, max1));
+    bounds.min = glm::vec3(min[0], min[1], min[2]);
+    bounds.max = glm::vec3(max[0], max[1], max[2]);
+  }
+#endif
+  for (; i < count; ++i) {
+    glm::vec3 position;
+    std::memcpy(&position, data + i * byteStride, sizeof(position));
+    bounds.min = glm::min(bounds.min, position);
+    bounds.max = glm::max(bounds.max, position);
+  }
+  return bounds;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <limits>
+
+// Axis-aligned bounding box, empty when min > max
+struct Bounds
+{
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  bool empty() const { return min.x > max.x; }
+
+  void extend(const Bounds &other)
+  {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+};
+
+// Bounds of box transformed by matrix, from its center and half extent
+// (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+Bounds transformBounds(const Bounds &box, const glm::mat4 &matrix);
+
+// Bounds of count positions (3 floats) byteStride bytes apart, computed with
+// SSE when available. Single-threaded: the loop is bound by memory bandwidth.
+Bounds computePositionBounds(
+    const unsigned char *data, size_t count, size_t byteStride);
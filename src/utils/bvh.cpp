@@ -0,0 +1,394 @@
+#include "bvh.hpp"
+#include "culling.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace
+{
+
+// Leaves hold at most that many items; fewer when splitting is cheaper
+const int MAX_LEAF_SIZE = 4;
+const int BIN_COUNT = 16;
+// Cost of visiting an inner node, relative to testing an item
+const float TRAVERSAL_COST = 1.f;
+
+// Masks of the frustum planes a node may still cross
+const unsigned ALL_PLANES = (1u << 6) - 1;
+
+float getSurfaceArea(const Bounds &box)
+{
+  if (box.empty()) {
+    return 0.f;
+  }
+  const auto extent = box.max - box.min;
+  return 2.f *
+         (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Item being sorted into a hierarchy, its bounds stored along with it so that
+// they are read sequentially
+struct BuildItem
+{
+  Bounds bounds;
+  glm::vec3 centroid;
+  int index;
+};
+
+int getBin(float centroid, float axisMin, float axisExtent)
+{
+  return std::min(
+      BIN_COUNT - 1, int(BIN_COUNT * (centroid - axisMin) / axisExtent));
+}
+
+// Reorder items[first, last) around the split minimizing the surface area
+// heuristic and return its position, or first if a leaf is cheaper
+int findSplit(
+    std::vector<BuildItem> &items, int first, int last, const Bounds &bounds)
+{
+  Bounds centroidBounds;
+  for (auto i = first; i < last; ++i) {
+    centroidBounds.extend({items[i].centroid, items[i].centroid});
+  }
+  const auto centroidExtent = centroidBounds.max - centroidBounds.min;
+
+  // Bin along the 3 axes in a single pass over the items
+  Bounds binBounds[3][BIN_COUNT];
+  int binCounts[3][BIN_COUNT] = {};
+  for (auto i = first; i < last; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      if (centroidExtent[axis] > 0.f) {
+        const auto bin = getBin(items[i].centroid[axis],
+            centroidBounds.min[axis], centroidExtent[axis]);
+        binBounds[axis][bin].extend(items[i].bounds);
+        ++binCounts[axis][bin];
+      }
+    }
+  }
+
+  const auto surfaceArea = getSurfaceArea(bounds);
+  auto bestCost = float(last - first) * surfaceArea;
+  auto bestAxis = -1;
+  auto bestBin = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (centroidExtent[axis] <= 0.f) {
+      continue;
+    }
+    // Cost of the split after each bin: sweep from the right, then the left
+    float rightCosts[BIN_COUNT];
+    Bounds right;
+    auto rightCount = 0;
+    for (auto bin = BIN_COUNT - 1; bin > 0; --bin) {
+      right.extend(binBounds[axis][bin]);
+      rightCount += binCounts[axis][bin];
+      rightCosts[bin - 1] = float(rightCount) * getSurfaceArea(right);
+    }
+    Bounds left;
+    auto leftCount = 0;
+    for (auto bin = 0; bin < BIN_COUNT - 1; ++bin) {
+      left.extend(binBounds[axis][bin]);
+      leftCount += binCounts[axis][bin];
+      const auto cost = TRAVERSAL_COST * surfaceArea +
+                        float(leftCount) * getSurfaceArea(left) +
+                        rightCosts[bin];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+
+  const auto itemsBegin = begin(items) + first;
+  const auto itemsEnd = begin(items) + last;
+  if (bestAxis < 0) {
+    if (last - first <= MAX_LEAF_SIZE) {
+      return first;
+    }
+    // Too many items for a leaf, but no better split: split at the median
+    const auto axis =
+        centroidExtent.x >= centroidExtent.y &&
+                centroidExtent.x >= centroidExtent.z
+            ? 0
+            : (centroidExtent.y >= centroidExtent.z ? 1 : 2);
+    const auto middle = first + (last - first) / 2;
+    std::nth_element(itemsBegin, begin(items) + middle, itemsEnd,
+        [&](const BuildItem &a, const BuildItem &b) {
+          return a.centroid[axis] < b.centroid[axis];
+        });
+    return middle;
+  }
+
+  const auto split =
+      std::partition(itemsBegin, itemsEnd, [&](const BuildItem &item) {
+        return getBin(item.centroid[bestAxis], centroidBounds.min[bestAxis],
+                   centroidExtent[bestAxis]) <= bestBin;
+      });
+  return int(split - begin(items));
+}
+
+// Signed distances of the nearest and furthest corners of box along the normal
+// of plane
+void getPlaneDistances(const Bounds &box, const glm::vec4 &plane,
+    float &nearDistance, float &farDistance)
+{
+  const auto normal = glm::vec3(plane);
+  const auto center = (box.min + box.max) * 0.5f;
+  const auto halfExtent = (box.max - box.min) * 0.5f;
+  const auto distance = glm::dot(normal, center) + plane.w;
+  const auto radius = glm::dot(glm::abs(normal), halfExtent);
+  nearDistance = distance - radius;
+  farDistance = distance + radius;
+}
+
+// Whether box may intersect the frustum, removing from planeMask the planes it
+// is entirely in front of
+bool isBoxVisible(
+    const Bounds &box, const Frustum &frustum, unsigned &planeMask)
+{
+  for (int p = 0; p < 6; ++p) {
+    if (!(planeMask & (1u << p))) {
+      continue;
+    }
+    float nearDistance, farDistance;
+    getPlaneDistances(box, frustum.planes[p], nearDistance, farDistance);
+    if (farDistance < 0.f) {
+      return false;
+    }
+    if (nearDistance >= 0.f) {
+      planeMask &= ~(1u << p);
+    }
+  }
+  return true;
+}
+
+// Distance along the ray at which it enters box, or a negative value if it
+// misses it before maxDistance
+float intersectRay(const Bounds &box, const glm::vec3 &origin,
+    const glm::vec3 &inverseDirection, float maxDistance)
+{
+  const auto t0 = (box.min - origin) * inverseDirection;
+  const auto t1 = (box.max - origin) * inverseDirection;
+  const auto tMin = glm::min(t0, t1);
+  const auto tMax = glm::max(t0, t1);
+  const auto entry = std::max({tMin.x, tMin.y, tMin.z, 0.f});
+  const auto exit = std::min({tMax.x, tMax.y, tMax.z, maxDistance});
+  return entry <= exit ? entry : -1.f;
+}
+
+void refitNode(Bvh &bvh, const std::vector<Bounds> &itemBounds, int nodeIdx)
+{
+  auto &node = bvh.nodes[nodeIdx];
+  node.bounds = Bounds();
+  if (node.isLeaf()) {
+    for (auto i = node.firstItem; i < node.firstItem + node.count; ++i) {
+      node.bounds.extend(itemBounds[bvh.items[i]]);
+    }
+  } else {
+    node.bounds.extend(bvh.nodes[nodeIdx + 1].bounds);
+    node.bounds.extend(bvh.nodes[node.rightChild].bounds);
+  }
+}
+
+} // namespace
+
+Bvh buildBvh(const std::vector<Bounds> &itemBounds)
+{
+  Bvh bvh;
+  bvh.itemLeaves.assign(itemBounds.size(), -1);
+  std::vector<BuildItem> items;
+  for (size_t i = 0; i < itemBounds.size(); ++i) {
+    const auto &box = itemBounds[i];
+    if (!box.empty()) {
+      items.push_back({box, (box.min + box.max) * 0.5f, int(i)});
+    }
+  }
+  if (items.empty()) {
+    return bvh;
+  }
+  bvh.nodes.reserve(2 * items.size() / MAX_LEAF_SIZE + 1);
+
+  // Explicit stack of (first item, last item, parent, whether the right
+  // child): the left child is popped first so that it follows its parent
+  struct Task
+  {
+    int first, last, parent;
+    bool isRightChild;
+  };
+  std::vector<Task> stack{{0, int(items.size()), -1, false}};
+  while (!stack.empty()) {
+    const auto task = stack.back();
+    stack.pop_back();
+
+    const auto nodeIdx = int(bvh.nodes.size());
+    if (task.isRightChild) {
+      bvh.nodes[task.parent].rightChild = nodeIdx;
+    }
+    bvh.parents.push_back(task.parent);
+    BvhNode node;
+    for (auto i = task.first; i < task.last; ++i) {
+      node.bounds.extend(items[i].bounds);
+    }
+    node.firstItem = task.first;
+    node.count = task.last - task.first;
+
+    const auto split =
+        node.count > 1 ? findSplit(items, task.first, task.last, node.bounds)
+                       : task.first;
+    if (split > task.first && split < task.last) {
+      // rightChild is set once the right child is created
+      node.rightChild = nodeIdx;
+      stack.push_back({split, task.last, nodeIdx, true});
+      stack.push_back({task.first, split, nodeIdx, false});
+    } else {
+      for (auto i = task.first; i < task.last; ++i) {
+        bvh.itemLeaves[items[i].index] = nodeIdx;
+      }
+    }
+    bvh.nodes.push_back(node);
+  }
+  bvh.refitFlags.resize(bvh.nodes.size());
+
+  bvh.items.reserve(items.size());
+  for (const auto &item : items) {
+    bvh.items.push_back(item.index);
+  }
+  return bvh;
+}
+
+void refitBvh(Bvh &bvh, const std::vector<Bounds> &itemBounds)
+{
+  // Children come after their parent
+  for (auto nodeIdx = int(bvh.nodes.size()) - 1; nodeIdx >= 0; --nodeIdx) {
+    refitNode(bvh, itemBounds, nodeIdx);
+  }
+}
+
+void refitBvh(Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const std::vector<int> &changedItems)
+{
+  // The leaves of the changed items and their ancestors, each ancestor walk
+  // stopping at a node already reached
+  std::vector<int> refittedNodes;
+  for (const auto item : changedItems) {
+    auto nodeIdx = bvh.itemLeaves[item];
+    while (nodeIdx >= 0 && !bvh.refitFlags[nodeIdx]) {
+      bvh.refitFlags[nodeIdx] = 1;
+      refittedNodes.push_back(nodeIdx);
+      nodeIdx = bvh.parents[nodeIdx];
+    }
+  }
+  std::sort(begin(refittedNodes), end(refittedNodes), std::greater<int>());
+  for (const auto nodeIdx : refittedNodes) {
+    refitNode(bvh, itemBounds, nodeIdx);
+    bvh.refitFlags[nodeIdx] = 0;
+  }
+}
+
+size_t cullBvh(const Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const Frustum &frustum, std::vector<uint8_t> &visible)
+{
+  if (bvh.empty()) {
+    return 0;
+  }
+  size_t visibleCount = 0;
+  // Nodes to visit, with the planes their parent was not entirely in front of
+  std::vector<std::pair<int, unsigned>> stack{{0, ALL_PLANES}};
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back().first;
+    auto planeMask = stack.back().second;
+    stack.pop_back();
+
+    const auto &node = bvh.nodes[nodeIdx];
+    if (!isBoxVisible(node.bounds, frustum, planeMask)) {
+      continue;
+    }
+    const auto itemsBegin = begin(bvh.items) + node.firstItem;
+    const auto itemsEnd = itemsBegin + node.count;
+    if (!planeMask) {
+      // Entirely inside the frustum
+      for (auto it = itemsBegin; it != itemsEnd; ++it) {
+        visible[*it] = 1;
+      }
+      visibleCount += node.count;
+    } else if (node.isLeaf()) {
+      for (auto it = itemsBegin; it != itemsEnd; ++it) {
+        auto itemPlaneMask = planeMask;
+        if (isBoxVisible(itemBounds[*it], frustum, itemPlaneMask)) {
+          visible[*it] = 1;
+          ++visibleCount;
+        }
+      }
+    } else {
+      stack.emplace_back(node.rightChild, planeMask);
+      stack.emplace_back(nodeIdx + 1, planeMask);
+    }
+  }
+  return visibleCount;
+}
+
+int raycastBvh(const Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+    float &distance)
+{
+  if (bvh.empty()) {
+    return -1;
+  }
+  // Zero components give infinite slab distances, which the min / max ignore
+  const auto inverseDirection = 1.f / direction;
+  auto nearestItem = -1;
+  auto nearestDistance = maxDistance;
+
+  // Nodes to visit with their entry distance, the nearest child on top
+  std::vector<std::pair<int, float>> stack;
+  const auto rootDistance =
+      intersectRay(bvh.nodes[0].bounds, origin, inverseDirection, maxDistance);
+  if (rootDistance >= 0.f) {
+    stack.emplace_back(0, rootDistance);
+  }
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back().first;
+    const auto entryDistance = stack.back().second;
+    stack.pop_back();
+    if (entryDistance >= nearestDistance) {
+      continue;
+    }
+
+    const auto &node = bvh.nodes[nodeIdx];
+    if (node.isLeaf()) {
+      for (auto i = node.firstItem; i < node.firstItem + node.count; ++i) {
+        const auto item = bvh.items[i];
+        const auto itemDistance = intersectRay(
+            itemBounds[item], origin, inverseDirection, nearestDistance);
+        if (itemDistance >= 0.f && itemDistance < nearestDistance) {
+          nearestDistance = itemDistance;
+          nearestItem = item;
+        }
+      }
+      continue;
+    }
+
+    auto nearChild = std::make_pair(nodeIdx + 1,
+        intersectRay(bvh.nodes[nodeIdx + 1].bounds, origin, inverseDirection,
+            nearestDistance));
+    auto farChild = std::make_pair(node.rightChild,
+        intersectRay(bvh.nodes[node.rightChild].bounds, origin,
+            inverseDirection, nearestDistance));
+    if (farChild.second >= 0.f &&
+        (nearChild.second < 0.f || farChild.second < nearChild.second)) {
+      std::swap(nearChild, farChild);
+    }
+    if (farChild.second >= 0.f) {
+      stack.push_back(farChild);
+    }
+    if (nearChild.second >= 0.f) {
+      stack.push_back(nearChild);
+    }
+  }
+
+  if (nearestItem >= 0) {
+    distance = nearestDistance;
+  }
+  return nearestItem;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "bounds.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Frustum;
+
+// Node of a Bvh, in depth-first order: the left child of an inner node
+// follows it, its right child is at rightChild. The items of its subtree are
+// the count items from firstItem in Bvh::items.
+struct BvhNode
+{
+  Bounds bounds;
+  int rightChild = -1; // Or -1 for a leaf
+  int firstItem = 0;
+  int count = 0;
+
+  bool isLeaf() const { return rightChild < 0; }
+};
+
+// Bounding volume hierarchy over the bounds of items, referenced by their
+// index in the array the hierarchy is built from. Empty bounds are left out.
+struct Bvh
+{
+  std::vector<BvhNode> nodes; // nodes[0] is the root
+  std::vector<int> items;
+
+  // For refits: parent of each node (or -1) and leaf of each item (or -1)
+  std::vector<int> parents;
+  std::vector<int> itemLeaves;
+  std::vector<uint8_t> refitFlags;
+
+  bool empty() const { return nodes.empty(); }
+};
+
+// Build a hierarchy over itemBounds, splitting nodes where the surface area
+// heuristic is the lowest among binned centroid splits
+Bvh buildBvh(const std::vector<Bounds> &itemBounds);
+
+// Recompute the node bounds of bvh after itemBounds changed, keeping its
+// topology: one pass over the nodes, in reverse order
+void refitBvh(Bvh &bvh, const std::vector<Bounds> &itemBounds);
+
+// Same as refitBvh(bvh, itemBounds), only recomputing the bounds of the
+// ancestors of changedItems
+void refitBvh(Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const std::vector<int> &changedItems);
+
+// Set visible[i] to 1 for the items i whose bounds may intersect the frustum,
+// leaving other entries untouched. Subtrees entirely inside or outside the
+// frustum are not traversed further. Return the number of items set visible.
+size_t cullBvh(const Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const Frustum &frustum, std::vector<uint8_t> &visible);
+
+// Return the nearest item whose bounds are hit by the ray origin + t *
+// direction with 0 <= t < maxDistance, setting distance to its t, or -1
+int raycastBvh(const Bvh &bvh, const std::vector<Bounds> &itemBounds,
+    const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+    float &distance);
@@ -0,0 +1,269 @@
+#include "culling.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+void updateWorldBounds(
+    PrimitiveInstances &instances, const FlatSceneGraph &graph, size_t i)
+{
+  const auto matrix = getWorldMatrix(instances, graph, i);
+  const auto &local = instances.localBounds[i];
+  instances.worldBounds[i] = transformBounds(local, matrix);
+  if (local.empty()) {
+    // Never visible
+    instances.centersX[i] = instances.centersY[i] = instances.centersZ[i] = 0;
+    instances.radii[i] = -std::numeric_limits<float>::max();
+    return;
+  }
+
+  // The sphere around the local box, scaled by the largest axis scale
+  const auto center =
+      glm::vec3(matrix * glm::vec4((local.min + local.max) * 0.5f, 1.f));
+  const auto maxScale = std::sqrt(std::max(
+      {glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+          glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1])),
+          glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]))}));
+  instances.centersX[i] = center.x;
+  instances.centersY[i] = center.y;
+  instances.centersZ[i] = center.z;
+  instances.radii[i] = glm::length(local.max - local.min) * 0.5f * maxScale;
+}
+
+bool isBoxVisible(const Bounds &box, const Frustum &frustum)
+{
+  for (const auto &plane : frustum.planes) {
+    // Corner of the box the furthest along the plane normal
+    const glm::vec3 corner(plane.x >= 0.f ? box.max.x : box.min.x,
+        plane.y >= 0.f ? box.max.y : box.min.y,
+        plane.z >= 0.f ? box.max.z : box.min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+Frustum extractFrustum(const glm::mat4 &viewProjMatrix)
+{
+  // glm matrices are column-major: row i is (m[0][i], m[1][i], m[2][i],
+  // m[3][i])
+  const auto row = [&](int i) {
+    return glm::vec4(viewProjMatrix[0][i], viewProjMatrix[1][i],
+        viewProjMatrix[2][i], viewProjMatrix[3][i]);
+  };
+  Frustum frustum;
+  for (int axis = 0; axis < 3; ++axis) {
+    frustum.planes[2 * axis] = row(3) + row(axis);
+    frustum.planes[2 * axis + 1] = row(3) - row(axis);
+  }
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+PrimitiveInstances buildPrimitiveInstances(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const FlatSceneGraph &graph)
+{
+  // Local bounds of each primitive, shared by the instances of its mesh
+  std::vector<std::vector<Bounds>> meshBounds(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    for (const auto &primitive : model.meshes[meshIdx].primitives) {
+      Bounds bounds;
+      const auto positionIt = primitive.attributes.find("POSITION");
+      if (positionIt != end(primitive.attributes)) {
+        bounds = getPositionBounds(
+            model, buffers, model.accessors[positionIt->second]);
+      }
+      meshBounds[meshIdx].push_back(bounds);
+    }
+  }
+
+  // Nodes drawn by the hierarchy, not to be drawn again as MSFT_lod levels
+  std::vector<bool> inGraph(model.nodes.size(), false);
+  for (const auto nodeIdx : graph.nodes) {
+    inGraph[nodeIdx] = true;
+  }
+
+  PrimitiveInstances instances;
+  for (size_t node = 0; node < graph.size(); ++node) {
+    const auto &gltfNode = model.nodes[graph.nodes[node]];
+    // Without EXT_mesh_gpu_instancing, a single instance without a matrix
+    const auto firstGpuInstance = int(instances.gpuInstanceMatrices.size());
+    const auto gpuInstanceMatrices =
+        readGpuInstanceMatrices(model, buffers, gltfNode);
+    instances.gpuInstanceMatrices.insert(end(instances.gpuInstanceMatrices),
+        begin(gpuInstanceMatrices), end(gpuInstanceMatrices));
+    const auto gpuInstanceCount =
+        std::max(gpuInstanceMatrices.size(), size_t(1));
+
+    // The mesh of the node then the meshes of its MSFT_lod levels, if any
+    auto lod = getMsftLod(model, gltfNode);
+    std::vector<int> levelMeshes{graph.meshes[node]};
+    std::vector<double> screenCoverages(begin(lod.screenCoverages),
+        begin(lod.screenCoverages) +
+            std::min(lod.screenCoverages.size(), size_t(1)));
+    for (size_t i = 0; i < lod.ids.size(); ++i) {
+      if (inGraph[lod.ids[i]]) {
+        std::cerr << "MSFT_lod node " << lod.ids[i]
+                  << " is in the scene, skipping" << std::endl;
+        continue;
+      }
+      levelMeshes.push_back(model.nodes[lod.ids[i]].mesh);
+      if (i + 1 < lod.screenCoverages.size()) {
+        screenCoverages.push_back(lod.screenCoverages[i + 1]);
+      }
+    }
+    lod.screenCoverages = screenCoverages;
+    auto maxCoverage = std::numeric_limits<float>::infinity();
+    for (size_t level = 0; level < levelMeshes.size(); ++level) {
+      // Without MSFT_screencoverage, each level covers half the screen
+      // coverage of the previous one, the last one down to 0
+      auto minCoverage = 0.f;
+      if (level < lod.screenCoverages.size()) {
+        minCoverage = float(lod.screenCoverages[level]);
+      } else if (level + 1 < levelMeshes.size()) {
+        minCoverage = std::pow(0.5f, float(level + 1));
+      }
+      const auto meshIdx = levelMeshes[level];
+      for (size_t gpuInstance = 0;
+           meshIdx >= 0 && gpuInstance < gpuInstanceCount; ++gpuInstance) {
+        for (size_t primitive = 0; primitive < meshBounds[meshIdx].size();
+             ++primitive) {
+          instances.nodes.push_back(int(node));
+          instances.meshes.push_back(meshIdx);
+          instances.primitives.push_back(int(primitive));
+          instances.localBounds.push_back(meshBounds[meshIdx][primitive]);
+          instances.gpuInstances.push_back(gpuInstanceMatrices.empty()
+                                               ? -1
+                                               : firstGpuInstance +
+                                                     int(gpuInstance));
+          instances.msftLodLevels.push_back(int(level));
+          instances.minScreenCoverages.push_back(minCoverage);
+          instances.maxScreenCoverages.push_back(maxCoverage);
+        }
+      }
+      maxCoverage = minCoverage;
+    }
+  }
+
+  const auto count = instances.size();
+  instances.centersX.resize(count);
+  instances.centersY.resize(count);
+  instances.centersZ.resize(count);
+  instances.radii.resize(count);
+  instances.worldBounds.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    updateWorldBounds(instances, graph, i);
+  }
+  instances.bvh = buildBvh(instances.worldBounds);
+  return instances;
+}
+
+void updatePrimitiveInstances(
+    PrimitiveInstances &instances, const FlatSceneGraph &graph)
+{
+  std::vector<int> updatedInstances;
+  for (const auto &range : graph.updatedRanges) {
+    auto i = size_t(
+        std::lower_bound(begin(instances.nodes), end(instances.nodes),
+            range.first) -
+        begin(instances.nodes));
+    for (; i < instances.size() && instances.nodes[i] < range.second; ++i) {
+      updateWorldBounds(instances, graph, i);
+      updatedInstances.push_back(int(i));
+    }
+  }
+
+  // Past a fraction of the instances, a pass over all nodes is cheaper than
+  // walking up from each instance
+  if (updatedInstances.size() > instances.size() / 4) {
+    refitBvh(instances.bvh, instances.worldBounds);
+  } else if (!updatedInstances.empty()) {
+    refitBvh(instances.bvh, instances.worldBounds, updatedInstances);
+  }
+}
+
+size_t cullPrimitiveInstances(const PrimitiveInstances &instances,
+    const Frustum &frustum, std::vector<uint8_t> &visible)
+{
+  const auto count = instances.size();
+  visible.resize(count);
+  size_t i = 0;
+#ifdef CULLING_SSE
+  // 4 spheres at a time: visible if no plane has them entirely behind it
+  __m128 planes[6][4];
+  for (int p = 0; p < 6; ++p) {
+    for (int c = 0; c < 4; ++c) {
+      planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+    }
+  }
+  for (; i + 4 <= count; i += 4) {
+    const auto x = _mm_loadu_ps(instances.centersX.data() + i);
+    const auto y = _mm_loadu_ps(instances.centersY.data() + i);
+    const auto z = _mm_loadu_ps(instances.centersZ.data() + i);
+    const auto minusRadius =
+        _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(instances.radii.data() + i));
+    auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      const auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+          _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, minusRadius));
+    }
+    const auto mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; ++lane) {
+      visible[i + lane] = uint8_t((mask >> lane) & 1);
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    const glm::vec3 center(
+        instances.centersX[i], instances.centersY[i], instances.centersZ[i]);
+    visible[i] = 1;
+    for (const auto &plane : frustum.planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -instances.radii[i]) {
+        visible[i] = 0;
+        break;
+      }
+    }
+  }
+
+  // Spheres are loose around elongated primitives: their boxes are tighter
+  size_t visibleCount = 0;
+  for (i = 0; i < count; ++i) {
+    if (visible[i]) {
+      visible[i] = uint8_t(isBoxVisible(instances.worldBounds[i], frustum));
+      visibleCount += visible[i];
+    }
+  }
+  return visibleCount;
+}
+
+size_t cullPrimitiveInstancesHierarchically(const PrimitiveInstances &instances,
+    const Frustum &frustum, std::vector<uint8_t> &visible)
+{
+  visible.assign(instances.size(), 0);
+  return cullBvh(instances.bvh, instances.worldBounds, frustum, visible);
+}
+
+int raycastPrimitiveInstances(const PrimitiveInstances &instances,
+    const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+    float &distance)
+{
+  return raycastBvh(instances.bvh, instances.worldBounds, origin, direction,
+      maxDistance, distance);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "bounds.hpp"
+#include "bvh.hpp"
+#include "gltf_loader.hpp"
+#include "scene_graph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Planes of a view frustum, pointing inwards, normalized so that dot(plane,
+// vec4(p, 1)) is the signed distance of p to the plane
+struct Frustum
+{
+  glm::vec4 planes[6]; // Left, right, bottom, top, near, far
+};
+
+// Extract the frustum planes of an OpenGL projection * view matrix (Gribb and
+// Hartmann)
+Frustum extractFrustum(const glm::mat4 &viewProjMatrix);
+
+// Every primitive drawn by a scene (a mesh primitive of a scene graph node),
+// sorted by node position, with its bounds in world space. World bounds are
+// stored as structures of arrays so that they are tested 4 at a time.
+// The meshes of the MSFT_lod levels of a node are instances of the node too,
+// drawn with its world matrix, each within a range of screen coverage.
+// A node with the EXT_mesh_gpu_instancing extension has one instance per
+// primitive and GPU instance, the matrix of the GPU instance applying before
+// the world matrix of the node.
+struct PrimitiveInstances
+{
+  std::vector<int> nodes; // Position in FlatSceneGraph
+  std::vector<int> meshes; // The mesh of the node or of one of its levels
+  std::vector<int> primitives; // Index in mesh.primitives
+  std::vector<Bounds> localBounds;
+
+  // Index in gpuInstanceMatrices, -1 without EXT_mesh_gpu_instancing
+  std::vector<int> gpuInstances;
+  std::vector<glm::mat4> gpuInstanceMatrices; // Relative to their node
+
+  // MSFT_lod level, 0 for the mesh of the node, and screen coverage range
+  // [min, max) where it is drawn: [0, infinity) for nodes without levels
+  std::vector<int> msftLodLevels;
+  std::vector<float> minScreenCoverages, maxScreenCoverages;
+
+  // World bounding spheres
+  std::vector<float> centersX, centersY, centersZ, radii;
+  std::vector<Bounds> worldBounds;
+
+  // Hierarchy over worldBounds
+  Bvh bvh;
+
+  size_t size() const { return nodes.size(); }
+};
+
+// World matrix of instance i
+inline glm::mat4 getWorldMatrix(const PrimitiveInstances &instances,
+    const FlatSceneGraph &graph, size_t i)
+{
+  const auto &nodeMatrix = graph.worldMatrices[instances.nodes[i]];
+  const auto gpuInstance = instances.gpuInstances[i];
+  return gpuInstance < 0
+             ? nodeMatrix
+             : nodeMatrix * instances.gpuInstanceMatrices[gpuInstance];
+}
+
+// List the primitives of a scene graph, with their local bounds from the
+// min / max of their POSITION accessor (see getPositionBounds()), and compute
+// their world bounds
+PrimitiveInstances buildPrimitiveInstances(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const FlatSceneGraph &graph);
+
+// Recompute the world bounds of the instances of the nodes updated by the last
+// update of graph (see FlatSceneGraph::updatedRanges), and refit their
+// hierarchy. Its topology is kept: it is built once, by
+// buildPrimitiveInstances().
+void updatePrimitiveInstances(
+    PrimitiveInstances &instances, const FlatSceneGraph &graph);
+
+// Set visible[i] to 1 if instance i may intersect the frustum, 0 otherwise.
+// Bounding spheres are tested first, with SSE when available, then the world
+// boxes of the spheres that pass. Return the number of visible instances.
+size_t cullPrimitiveInstances(const PrimitiveInstances &instances,
+    const Frustum &frustum, std::vector<uint8_t> &visible);
+
+// Same as cullPrimitiveInstances(), walking the hierarchy of the instances:
+// only the subtrees crossing the frustum boundary are tested further
+size_t cullPrimitiveInstancesHierarchically(const PrimitiveInstances &instances,
+    const Frustum &frustum, std::vector<uint8_t> &visible);
+
+// Return the instance whose world box is the nearest hit by the ray origin + t
+// * direction with 0 <= t < maxDistance, setting distance to its t, or -1
+int raycastPrimitiveInstances(const PrimitiveInstances &instances,
+    const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+    float &distance);
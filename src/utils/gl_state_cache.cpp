@@ -0,0 +1,138 @@
+#include "gl_state_cache.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+const GLuint GLStateCache::UNKNOWN;
+
+void GLStateCache::invalidate()
+{
+  m_program = UNKNOWN;
+  m_programUniforms = nullptr;
+  m_vertexArray = UNKNOWN;
+  m_activeTextureUnit = UNKNOWN;
+  std::fill(begin(m_textures), end(m_textures), UNKNOWN);
+  std::fill(begin(m_uniformBuffers), end(m_uniformBuffers),
+      BufferRange{UNKNOWN, 0, 0});
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+  if (program == m_program) {
+    ++m_counters.elided;
+    return;
+  }
+  glUseProgram(program);
+  ++m_counters.issued;
+  m_program = program;
+  m_programUniforms = &m_uniforms[program];
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+  if (vertexArray == m_vertexArray) {
+    ++m_counters.elided;
+    return;
+  }
+  glBindVertexArray(vertexArray);
+  ++m_counters.issued;
+  m_vertexArray = vertexArray;
+}
+
+void GLStateCache::bindTexture2D(GLuint unit, GLuint texture)
+{
+  if (unit >= m_textures.size()) {
+    m_textures.resize(unit + 1, UNKNOWN);
+  }
+  if (texture == m_textures[unit]) {
+    ++m_counters.elided;
+    return;
+  }
+  if (unit != m_activeTextureUnit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    ++m_counters.issued;
+    m_activeTextureUnit = unit;
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  ++m_counters.issued;
+  m_textures[unit] = texture;
+}
+
+void GLStateCache::bindUniformBufferRange(
+    GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+  if (index >= m_uniformBuffers.size()) {
+    m_uniformBuffers.resize(index + 1, BufferRange{UNKNOWN, 0, 0});
+  }
+  auto &range = m_uniformBuffers[index];
+  if (range.buffer == buffer && range.offset == offset && range.size == size) {
+    ++m_counters.elided;
+    return;
+  }
+  glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+  ++m_counters.issued;
+  range = BufferRange{buffer, offset, size};
+}
+
+void GLStateCache::uniform1i(GLint location, GLint value)
+{
+  if (updateUniform(location, &value, sizeof(value))) {
+    glUniform1i(location, value);
+  }
+}
+
+void GLStateCache::uniform1f(GLint location, GLfloat value)
+{
+  if (updateUniform(location, &value, sizeof(value))) {
+    glUniform1f(location, value);
+  }
+}
+
+void GLStateCache::uniform3f(GLint location, const glm::vec3 &value)
+{
+  if (updateUniform(location, glm::value_ptr(value), sizeof(value))) {
+    glUniform3fv(location, 1, glm::value_ptr(value));
+  }
+}
+
+void GLStateCache::uniform4f(GLint location, const glm::vec4 &value)
+{
+  if (updateUniform(location, glm::value_ptr(value), sizeof(value))) {
+    glUniform4fv(location, 1, glm::value_ptr(value));
+  }
+}
+
+void GLStateCache::uniformMatrix4f(GLint location, const glm::mat4 &value)
+{
+  if (updateUniform(location, glm::value_ptr(value), sizeof(value))) {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+  }
+}
+
+bool GLStateCache::updateUniform(
+    GLint location, const void *data, size_t size)
+{
+  if (location < 0) { // Inactive uniform, the call would do nothing
+    ++m_counters.elided;
+    return false;
+  }
+  if (!m_programUniforms) {
+    ++m_counters.issued;
+    return true;
+  }
+  auto &uniforms = *m_programUniforms;
+  if (size_t(location) >= uniforms.size()) {
+    uniforms.resize(location + 1);
+  }
+  auto &uniform = uniforms[location];
+  if (uniform.size == size && std::memcmp(uniform.words, data, size) == 0) {
+    ++m_counters.elided;
+    return false;
+  }
+  std::memcpy(uniform.words, data, size);
+  uniform.size = size;
+  ++m_counters.issued;
+  return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Shadow of the GL state set while drawing: the current program, vertex
+// array, active texture unit, 2D texture of each unit, uniform buffer range of
+// each binding point, and the uniform values last written to each program.
+// Calls setting a value that is already set are dropped and counted.
+// Bindings changed behind the back of the cache (by ImGui, the texture
+// streamer, renderToImage()...) must be forgotten with invalidate() before
+// drawing again. Uniform values belong to their program and are kept: they
+// must only be written through the cache.
+class GLStateCache
+{
+public:
+  struct Counters
+  {
+    size_t issued = 0; // GL calls made
+    size_t elided = 0; // GL calls dropped as redundant
+  };
+
+  // Forget the bindings: the next ones are all issued
+  void invalidate();
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vertexArray);
+  // Bind texture to GL_TEXTURE_2D of texture unit unit, activating it if
+  // needed
+  void bindTexture2D(GLuint unit, GLuint texture);
+  void bindUniformBufferRange(
+      GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+  // Uniforms of the current program. Written directly, without caching, while
+  // the current program is unknown.
+  void uniform1i(GLint location, GLint value);
+  void uniform1f(GLint location, GLfloat value);
+  void uniform3f(GLint location, const glm::vec3 &value);
+  void uniform4f(GLint location, const glm::vec4 &value);
+  void uniformMatrix4f(GLint location, const glm::mat4 &value);
+
+  const Counters &counters() const { return m_counters; }
+  void resetCounters() { m_counters = Counters(); }
+
+private:
+  // Raw bytes of a uniform value, compared with memcmp
+  struct UniformValue
+  {
+    uint32_t words[16];
+    size_t size = 0; // In bytes, 0 until written
+  };
+
+  // Whether the value of uniform location of the current program changes, in
+  // which case it is recorded
+  bool updateUniform(GLint location, const void *data, size_t size);
+
+  struct BufferRange
+  {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  static const GLuint UNKNOWN = ~GLuint(0);
+
+  GLuint m_program = UNKNOWN;
+  GLuint m_vertexArray = UNKNOWN;
+  GLuint m_activeTextureUnit = UNKNOWN;
+  std::vector<GLuint> m_textures; // Per unit, UNKNOWN if not known
+  // Per binding point, with an UNKNOWN buffer if not known
+  std::vector<BufferRange> m_uniformBuffers;
+  std::unordered_map<GLuint, std::vector<UniformValue>> m_uniforms;
+  std::vector<UniformValue> *m_programUniforms = nullptr; // Of m_program
+  Counters m_counters;
+};
@@ -1,8 +1,10 @@
 #include "gltf.hpp"
+#include "scene_visitor.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 glm::mat4 getLocalToWorldMatrix(
@@ -35,122 +37,246 @@ glm::mat4 getLocalToWorldMatrix(
                                                  node.scale[1], node.scale[2]));
 };
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+MsftLod getMsftLod(
+    const tinygltf::Model &model, const tinygltf::Node &node)
 {
-  // Compute scene bounding box
-  // todo refactor with scene drawing
-  // todo need a visitScene generic function that takes a accept() functor
-  bboxMin = glm::vec3(std::numeric_limits<float>::max());
-  bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
-  if (model.defaultScene >= 0) {
-    const std::function<void(int, const glm::mat4 &)> updateBounds =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix) {
-          const auto &node = model.nodes[nodeIdx];
-          const glm::mat4 modelMatrix =
-              getLocalToWorldMatrix(node, parentMatrix);
-          if (node.mesh >= 0) {
-            const auto &mesh = model.meshes[node.mesh];
-            for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
-              const auto &primitive = mesh.primitives[pIdx];
-              const auto positionAttrIdxIt =
-                  primitive.attributes.find("POSITION");
-              if (positionAttrIdxIt == end(primitive.attributes)) {
-                continue;
-              }
-              const auto &positionAccessor =
-                  model.accessors[(*positionAttrIdxIt).second];
-              if (positionAccessor.type != 3) {
-                std::cerr << "Position accessor with type != VEC3, skipping"
-                          << std::endl;
-                continue;
-              }
-              const auto &positionBufferView =
-                  model.bufferViews[positionAccessor.bufferView];
-              const auto byteOffset =
-                  positionAccessor.byteOffset + positionBufferView.byteOffset;
-              const auto &positionBuffer =
-                  model.buffers[positionBufferView.buffer];
-              const auto positionByteStride =
-                  positionBufferView.byteStride ? positionBufferView.byteStride
-                                                : 3 * sizeof(float);
-
-              if (primitive.indices >= 0) {
-                const auto &indexAccessor = model.accessors[primitive.indices];
-                const auto &indexBufferView =
-                    model.bufferViews[indexAccessor.bufferView];
-                const auto indexByteOffset =
-                    indexAccessor.byteOffset + indexBufferView.byteOffset;
-                const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-                auto indexByteStride = indexBufferView.byteStride;
-
-                switch (indexAccessor.componentType) {
-                default:
-                  std::cerr
-                      << "Primitive index accessor with bad componentType "
-                      << indexAccessor.componentType << ", skipping it."
-                      << std::endl;
-                  continue;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint8_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint16_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint32_t);
-                  break;
-                }
-                
-                for (size_t i = 0; i < indexAccessor.count; ++i) {
-                  uint32_t index = 0;
-                  switch (indexAccessor.componentType) {
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    index = *((const uint8_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    index = *((const uint16_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    index = *((const uint32_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  }
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * index]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              } else {
-
-                for (size_t i = 0; i < positionAccessor.count; ++i) {
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * i]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              }
-            }
-          }
-          for (const auto childNodeIdx : node.children) {
-            updateBounds(childNodeIdx, modelMatrix);
-          }
-        };
-    for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-      updateBounds(nodeIdx, glm::mat4(1));
+  MsftLod lod;
+  const auto it = node.extensions.find("MSFT_lod");
+  if (it == end(node.extensions) || !it->second.Has("ids")) {
+    return lod;
+  }
+  std::vector<double> coverages;
+  if (node.extras.Has("MSFT_screencoverage")) {
+    const auto &values = node.extras.Get("MSFT_screencoverage");
+    for (size_t i = 0; i < values.ArrayLen(); ++i) {
+      coverages.push_back(values.Get(int(i)).GetNumberAsDouble());
     }
   }
+  if (!coverages.empty()) { // Of the node itself
+    lod.screenCoverages.push_back(coverages[0]);
+  }
+  const auto &ids = it->second.Get("ids");
+  for (size_t i = 0; i < ids.ArrayLen(); ++i) {
+    const auto id = ids.Get(int(i)).GetNumberAsInt();
+    if (id < 0 || size_t(id) >= model.nodes.size()) {
+      std::cerr << "MSFT_lod node " << id << " out of range, skipping"
+                << std::endl;
+      continue;
+    }
+    lod.ids.push_back(id);
+    // Coverages are a prefix of the levels: those kept stay aligned
+    if (i + 1 < coverages.size()) {
+      lod.screenCoverages.push_back(coverages[i + 1]);
+    }
+  }
+  return lod;
 }
 
+std::map<std::string, int> getGpuInstancingAttributes(
+    const tinygltf::Node &node)
+{
+  std::map<std::string, int> attributes;
+  const auto it = node.extensions.find("EXT_mesh_gpu_instancing");
+  if (it == end(node.extensions) || !it->second.Has("attributes")) {
+    return attributes;
+  }
+  const auto &object = it->second.Get("attributes");
+  for (const auto &name : object.Keys()) {
+    attributes[name] = object.Get(name).GetNumberAsInt();
+  }
+  return attributes;
+}
+
+std::vector<glm::mat4> readGpuInstanceMatrices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Node &node)
+{
+  const auto attributes = getGpuInstancingAttributes(node);
+  std::vector<glm::vec3> translations, scales;
+  std::vector<glm::quat> rotations;
+  size_t count = 0;
+  for (const auto &attribute : attributes) {
+    if (attribute.second < 0 ||
+        size_t(attribute.second) >= model.accessors.size()) {
+      return {};
+    }
+    const auto &accessor = model.accessors[attribute.second];
+    count = std::max(count, accessor.count);
+    if (attribute.first == "TRANSLATION") {
+      translations = readVectors<3>(model, buffers, accessor);
+    } else if (attribute.first == "SCALE") {
+      scales = readVectors<3>(model, buffers, accessor);
+    } else if (attribute.first == "ROTATION") {
+      for (const auto &rotation : readVectors<4>(model, buffers, accessor)) {
+        // Stored as x, y, z, w
+        rotations.emplace_back(rotation.w, rotation.x, rotation.y, rotation.z);
+      }
+    }
+  }
+  if ((!translations.empty() && translations.size() != count) ||
+      (!rotations.empty() && rotations.size() != count) ||
+      (!scales.empty() && scales.size() != count)) {
+    std::cerr << "EXT_mesh_gpu_instancing attributes of different counts or "
+                 "unsupported types, skipping"
+              << std::endl;
+    return {};
+  }
+
+  std::vector<glm::mat4> matrices(count, glm::mat4(1));
+  for (size_t i = 0; i < count; ++i) {
+    if (!translations.empty()) {
+      matrices[i] = glm::translate(matrices[i], translations[i]);
+    }
+    if (!rotations.empty()) {
+      matrices[i] *= glm::mat4_cast(rotations[i]);
+    }
+    if (!scales.empty()) {
+      matrices[i] = glm::scale(matrices[i], scales[i]);
+    }
+  }
+  return matrices;
+}
+
+Bounds getPositionBounds(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+    // In the units of the components, normalized or not
+    const auto scale = getNormalizationScale(accessor);
+    Bounds bounds;
+    for (int i = 0; i < 3; ++i) {
+      bounds.min[i] = float(accessor.minValues[i]) * scale;
+      bounds.max[i] = float(accessor.maxValues[i]) * scale;
+    }
+    return bounds;
+  }
 
+  const auto floatPositions =
+      makeAccessorView<glm::vec3>(model, buffers, accessor);
+  if (!floatPositions.empty()) {
+    return computePositionBounds(floatPositions.data(), floatPositions.size(),
+        floatPositions.byteStride());
+  }
+  Bounds bounds;
+  if (!visitVectorView<3>(
+          model, buffers, accessor, [&](const auto &positions, float scale) {
+            forEachElement(positions, [&](size_t, const auto &position) {
+              bounds.min = glm::min(bounds.min, glm::vec3(position));
+              bounds.max = glm::max(bounds.max, glm::vec3(position));
+            });
+            // Scaling keeps min > max for empty bounds
+            bounds.min *= scale;
+            bounds.max *= scale;
+          })) {
+    std::cerr << "Position accessor without min / max that is not a VEC3 "
+                 "with a bufferView, skipping"
+              << std::endl;
+    return Bounds{};
+  }
+  return bounds;
+}
+
+std::vector<uint32_t> readIndices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  std::vector<uint32_t> indices;
+  visitIndexView(model, buffers, accessor, [&](const auto &view) {
+    indices.resize(view.size());
+    forEachElement(view,
+        [&](size_t i, uint32_t index) { indices[i] = index; });
+  });
+  return indices;
+}
+
+std::vector<glm::vec3> readPositions(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  return readVectors<3>(model, buffers, accessor);
+}
+
+void computeSceneBounds(const tinygltf::Model &model,
+    const GltfBuffers &buffers, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+{
+  Bounds sceneBounds;
+  // Local bounds of each mesh, computed on first use: each instance then only
+  // transforms a box
+  std::vector<Bounds> meshBounds(model.meshes.size());
+  std::vector<bool> hasMeshBounds(model.meshes.size(), false);
+  const auto getMeshBounds = [&](int meshIdx) -> const Bounds & {
+    if (!hasMeshBounds[meshIdx]) {
+      for (const auto &primitive : model.meshes[meshIdx].primitives) {
+        const auto positionIt = primitive.attributes.find("POSITION");
+        if (positionIt != end(primitive.attributes)) {
+          meshBounds[meshIdx].extend(getPositionBounds(
+              model, buffers, model.accessors[positionIt->second]));
+        }
+      }
+      hasMeshBounds[meshIdx] = true;
+    }
+    return meshBounds[meshIdx];
+  };
+
+  visitScene(model, model.defaultScene,
+      [&](int nodeIdx, const glm::mat4 &worldMatrix) {
+        const auto &node = model.nodes[nodeIdx];
+        if (node.mesh < 0) {
+          return true;
+        }
+        const auto &bounds = getMeshBounds(node.mesh);
+        // Every EXT_mesh_gpu_instancing copy, which may lie far from the mesh
+        const auto gpuInstanceMatrices =
+            readGpuInstanceMatrices(model, buffers, node);
+        if (gpuInstanceMatrices.empty()) {
+          sceneBounds.extend(transformBounds(bounds, worldMatrix));
+        }
+        for (const auto &gpuInstanceMatrix : gpuInstanceMatrices) {
+          sceneBounds.extend(
+              transformBounds(bounds, worldMatrix * gpuInstanceMatrix));
+        }
+        return true;
+      });
+  bboxMin = sceneBounds.min;
+  bboxMax = sceneBounds.max;
+}
+
+CompactBufferLayout computeCompactBufferLayout(const tinygltf::Model &model,
+    const std::vector<std::string> &attributes)
+{
+  std::vector<bool> isUsed(model.bufferViews.size(), false);
+  const auto markAccessor = [&](int accessorIdx) {
+    if (accessorIdx >= 0 && model.accessors[accessorIdx].bufferView >= 0) {
+      isUsed[model.accessors[accessorIdx].bufferView] = true;
+    }
+  };
+  for (const auto &mesh : model.meshes) {
+    for (const auto &primitive : mesh.primitives) {
+      markAccessor(primitive.indices);
+      for (const auto &name : attributes) {
+        const auto it = primitive.attributes.find(name);
+        if (it != end(primitive.attributes)) {
+          markAccessor((*it).second);
+        }
+      }
+    }
+  }
+
+  // glTF only aligns accessor.byteOffset + bufferView.byteOffset to the
+  // component size: packed bufferViews keep their byteOffset modulo the
+  // largest component size, so that the accessors keep their alignment
+  const size_t alignment = 4;
+
+  CompactBufferLayout layout;
+  layout.bufferSizes.resize(model.buffers.size(), 0);
+  layout.bufferViewOffsets.resize(model.bufferViews.size(), -1);
+  for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+    if (!isUsed[i]) {
+      continue;
+    }
+    const auto &bufferView = model.bufferViews[i];
+    auto &bufferSize = layout.bufferSizes[bufferView.buffer];
+    bufferSize = (bufferSize + alignment - 1) / alignment * alignment +
+                 bufferView.byteOffset % alignment;
+    layout.bufferViewOffsets[i] = ptrdiff_t(bufferSize);
+    bufferSize += bufferView.byteLength;
+  }
+  return layout;
+}
@@ -3,11 +3,78 @@
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 
+#include "accessor_view.hpp"
+#include "bounds.hpp"
+#include "gltf_loader.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+// Levels of detail of a node given by the MSFT_lod extension: the nodes
+// replacing it, from the finest to the coarsest, and the minimum screen
+// coverage of each level, the node itself first, from the MSFT_screencoverage
+// extras. Both are empty without the extension. The ids out of the range of
+// model.nodes are dropped with a warning, with their screen coverage.
+struct MsftLod
+{
+  std::vector<int> ids;
+  std::vector<double> screenCoverages;
+};
+MsftLod getMsftLod(
+    const tinygltf::Model &model, const tinygltf::Node &node);
+
+// Accessors of the per-instance TRANSLATION, ROTATION and SCALE attributes of
+// a node drawn with the EXT_mesh_gpu_instancing extension, by attribute name.
+// Empty without the extension.
+std::map<std::string, int> getGpuInstancingAttributes(
+    const tinygltf::Node &node);
+
+// Matrices of the instances of a node drawn with EXT_mesh_gpu_instancing,
+// relative to the node. Empty without the extension or if its attributes
+// cannot be read.
+std::vector<glm::mat4> readGpuInstanceMatrices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Node &node);
+
+// Local bounds of a POSITION accessor: its min / max, required by the glTF
+// specification, or the bounds of its vertices if they are missing
+Bounds getPositionBounds(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor);
+
+// Indices of an accessor of unsigned bytes, shorts or ints, widened to 32 bits,
+// empty for other accessors
+std::vector<uint32_t> readIndices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor);
+
+// Positions of a VEC3 accessor of floats or of (normalized) integers, as
+// floats, empty for other accessors
+std::vector<glm::vec3> readPositions(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor);
+
+// Bounds of the default scene, from the bounds of each mesh instance,
+// including the EXT_mesh_gpu_instancing copies: the cost depends on the number
+// of nodes and GPU instances, not on the number of vertices
+void computeSceneBounds(const tinygltf::Model &model,
+    const GltfBuffers &buffers, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Where the bufferViews read by the renderer go once packed, without the
+// bytes nobody reads (images, animations, unused attributes...), in one GPU
+// buffer per glTF buffer
+struct CompactBufferLayout
+{
+  std::vector<size_t> bufferSizes; // One per model.buffers, 0 if unused
+  // One per model.bufferViews: offset in its packed buffer, -1 if unused
+  std::vector<ptrdiff_t> bufferViewOffsets;
+};
+
+// Keep the bufferViews of the primitive indices and of the vertex attributes
+// whose name is in attributes
+CompactBufferLayout computeCompactBufferLayout(const tinygltf::Model &model,
+    const std::vector<std::string> &attributes);
 
 //void computeTangents(const tinygltf::Model &model);
 
@@ -0,0 +1,117 @@
+#include "gltf_dedup.hpp"
+#include "hash.hpp"
+
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+namespace
+{
+
+// Index of the first span with the same bytes as each span, spans[i] itself
+// if it is the first one. Empty spans are never merged.
+std::vector<int> findDuplicateSpans(
+    const std::vector<ByteSpan> &spans, size_t &hashedBytes)
+{
+  std::vector<int> firsts(spans.size());
+  std::unordered_multimap<uint64_t, int> spansByHash;
+  for (size_t i = 0; i < spans.size(); ++i) {
+    firsts[i] = int(i);
+    const auto &span = spans[i];
+    if (!span.size) {
+      continue;
+    }
+    hashedBytes += span.size;
+    const auto hash = hashBytes(span.data, span.size);
+    const auto range = spansByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto &other = spans[it->second];
+      if (other.size == span.size &&
+          std::memcmp(other.data, span.data, span.size) == 0) {
+        firsts[i] = it->second;
+        break;
+      }
+    }
+    if (firsts[i] == int(i)) {
+      spansByHash.emplace(hash, int(i));
+    }
+  }
+  return firsts;
+}
+
+} // namespace
+
+DeduplicationStats deduplicateResources(
+    tinygltf::Model &model, GltfBuffers &buffers)
+{
+  DeduplicationStats stats;
+
+  const auto bufferFirsts =
+      findDuplicateSpans(buffers.spans, stats.hashedBytes);
+  for (auto &bufferView : model.bufferViews) {
+    bufferView.buffer = bufferFirsts[bufferView.buffer];
+  }
+  for (size_t i = 0; i < bufferFirsts.size(); ++i) {
+    if (bufferFirsts[i] != int(i)) {
+      ++stats.bufferCount;
+      stats.bufferBytes += buffers.spans[i].size;
+      buffers.spans[i] = ByteSpan{};
+    }
+  }
+
+  const auto imageFirsts =
+      findDuplicateSpans(buffers.encodedImages, stats.hashedBytes);
+  for (auto &texture : model.textures) {
+    if (texture.source >= 0) {
+      texture.source = imageFirsts[texture.source];
+    }
+  }
+  for (size_t i = 0; i < imageFirsts.size(); ++i) {
+    if (imageFirsts[i] != int(i)) {
+      ++stats.imageCount;
+      stats.imageBytes += buffers.encodedImages[i].size;
+      buffers.encodedImages[i] = ByteSpan{};
+    }
+  }
+
+  // Textures are compared on the state of their sampler, not its index
+  const tinygltf::Sampler defaultSampler;
+  const auto samplerState = [&](int samplerIdx) {
+    const auto &sampler =
+        samplerIdx >= 0 ? model.samplers[samplerIdx] : defaultSampler;
+    return std::make_tuple(
+        sampler.minFilter, sampler.magFilter, sampler.wrapS, sampler.wrapT);
+  };
+  std::vector<int> textureFirsts(model.textures.size());
+  std::map<std::tuple<int, int, int, int, int>, int> texturesByState;
+  for (size_t i = 0; i < model.textures.size(); ++i) {
+    auto &texture = model.textures[i];
+    textureFirsts[i] = int(i);
+    if (texture.source < 0) {
+      continue;
+    }
+    const auto key = std::tuple_cat(
+        std::make_tuple(texture.source), samplerState(texture.sampler));
+    const auto inserted = texturesByState.emplace(key, int(i));
+    if (!inserted.second) {
+      textureFirsts[i] = inserted.first->second;
+      texture.source = -1; // Never uploaded
+      ++stats.textureCount;
+    }
+  }
+  const auto remap = [&](int &textureIdx) {
+    if (textureIdx >= 0) {
+      textureIdx = textureFirsts[textureIdx];
+    }
+  };
+  for (auto &material : model.materials) {
+    remap(material.pbrMetallicRoughness.baseColorTexture.index);
+    remap(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+    remap(material.normalTexture.index);
+    remap(material.occlusionTexture.index);
+    remap(material.emissiveTexture.index);
+  }
+
+  return stats;
+}
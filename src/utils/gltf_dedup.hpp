@@ -0,0 +1,27 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <tiny_gltf.h>
+
+struct DeduplicationStats
+{
+  size_t bufferCount = 0; // Duplicates collapsed
+  size_t imageCount = 0;
+  size_t textureCount = 0;
+  size_t bufferBytes = 0; // Bytes that will not be uploaded / decoded
+  size_t imageBytes = 0; // Encoded bytes
+  size_t hashedBytes = 0;
+};
+
+// Collapse the duplicated resources of a model loaded with loadGltf(), in
+// place, so that each one is decoded and uploaded once:
+// - bufferViews of a buffer identical to a previous one are moved to it (at
+// the same offsets) and the span of the duplicate is emptied;
+// - textures whose image has the same encoded bytes as a previous one use it,
+// the encoded span of the duplicate is emptied so it is never decoded;
+// - materials use the first texture with the same image and sampler state,
+// the source of the other ones is set to -1.
+// Contents are compared by hash, then byte by byte.
+DeduplicationStats deduplicateResources(
+    tinygltf::Model &model, GltfBuffers &buffers);
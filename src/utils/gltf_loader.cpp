@@ -0,0 +1,388 @@
+#include "gltf_loader.hpp"
+#include "base64.hpp"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+
+// One byte buffer handed to tinygltf in place of the real buffers, so that it
+// parses everything else without copying the buffer contents
+const char *const STUB_BUFFER_URI = "data:application/octet-stream;base64,AA==";
+
+uint32_t readUint32(const unsigned char *bytes)
+{
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value)); // glTF is little endian
+  return value;
+}
+
+// Locate the JSON and BIN chunks of a .glb file
+bool parseGlbChunks(const MappedFile &file, ByteSpan &jsonChunk,
+    ByteSpan &binChunk, std::string &err)
+{
+  const auto *bytes = file.data();
+  if (file.size() < 20 || readUint32(bytes) != GLB_MAGIC) {
+    err += "Invalid glTF binary header.\n";
+    return false;
+  }
+  const size_t length = std::min(size_t(readUint32(bytes + 8)), file.size());
+
+  size_t offset = 12;
+  while (offset + 8 <= length) {
+    const size_t chunkLength = readUint32(bytes + offset);
+    const auto chunkType = readUint32(bytes + offset + 4);
+    offset += 8;
+    if (offset + chunkLength > length) {
+      err += "Invalid glTF binary chunk length.\n";
+      return false;
+    }
+    if (chunkType == GLB_CHUNK_JSON && !jsonChunk.data) {
+      jsonChunk = ByteSpan{bytes + offset, chunkLength};
+    } else if (chunkType == GLB_CHUNK_BIN && !binChunk.data) {
+      binChunk = ByteSpan{bytes + offset, chunkLength};
+    }
+    offset += chunkLength;
+  }
+
+  if (!jsonChunk.data) {
+    err += "glTF binary has no JSON chunk.\n";
+    return false;
+  }
+  return true;
+}
+
+// String member of a JSON object without copying it (data URIs can be huge),
+// empty if missing
+const std::string &getStringRef(const nlohmann::json &object, const char *key)
+{
+  static const std::string empty;
+  const auto it = object.find(key);
+  return it != object.end() && it->is_string()
+             ? it->get_ref<const std::string &>()
+             : empty;
+}
+
+bool isDataUri(const std::string &uri)
+{
+  return uri.compare(0, 5, "data:") == 0;
+}
+
+// Decode a base64 data URI straight into a new buffers.ownedData entry
+bool decodeDataUri(
+    const std::string &uri, GltfBuffers &buffers, std::string &mimeType)
+{
+  const std::string base64Marker = ";base64,";
+  const auto markerPos = uri.find(base64Marker);
+  if (!isDataUri(uri) || markerPos == std::string::npos) {
+    return false;
+  }
+  mimeType = uri.substr(5, markerPos - 5);
+
+  const auto *src = uri.data() + markerPos + base64Marker.size();
+  const auto size = uri.size() - markerPos - base64Marker.size();
+  buffers.ownedData.emplace_back(getBase64DecodedSize(src, size));
+  if (!decodeBase64(src, size, buffers.ownedData.back().data())) {
+    buffers.ownedData.pop_back();
+    return false;
+  }
+  return true;
+}
+
+// Resolve the bytes of buffer bufferIdx described by jsonBuffer, mapping or
+// decoding them in buffers storage
+bool resolveBuffer(const nlohmann::json &jsonBuffer, size_t bufferIdx,
+    const fs::path &baseDir, const ByteSpan &binChunk, GltfBuffers &buffers,
+    std::string &err)
+{
+  const auto byteLength = jsonBuffer.value("byteLength", size_t(0));
+  const auto &uri = getStringRef(jsonBuffer, "uri");
+
+  ByteSpan span;
+  if (uri.empty()) {
+    // Only the first buffer of a .glb may reference the BIN chunk
+    if (bufferIdx != 0 || binChunk.size < byteLength) {
+      err += "Invalid binary data for buffer " + std::to_string(bufferIdx) +
+             ".\n";
+      return false;
+    }
+    span = ByteSpan{binChunk.data, byteLength};
+  } else if (isDataUri(uri)) {
+    std::string mimeType;
+    if (!decodeDataUri(uri, buffers, mimeType) ||
+        buffers.ownedData.back().size() < byteLength) {
+      err += "Failed to decode data URI of buffer " +
+             std::to_string(bufferIdx) + ".\n";
+      return false;
+    }
+    span = ByteSpan{buffers.ownedData.back().data(), byteLength};
+  } else {
+    try {
+      buffers.mappedFiles.emplace_back(baseDir / uri);
+    } catch (const std::runtime_error &e) {
+      err += std::string(e.what()) + "\n";
+      return false;
+    }
+    const auto &file = buffers.mappedFiles.back();
+    if (file.size() < byteLength) {
+      err += "File " + uri + " is smaller than byteLength of buffer " +
+             std::to_string(bufferIdx) + ".\n";
+      return false;
+    }
+    span = ByteSpan{file.data(), byteLength};
+  }
+
+  buffers.spans.push_back(span);
+  return true;
+}
+
+// Resolve the encoded bytes of the image described by jsonImage, from its
+// bufferView, its data URI or its external file. Leave source empty if the
+// external file cannot be mapped: tinygltf then reports it as usual.
+bool resolveImage(nlohmann::json &jsonImage, size_t imageIdx,
+    const nlohmann::json *jsonBufferViews, const fs::path &baseDir,
+    GltfBuffers &buffers, ByteSpan &source, std::string &err)
+{
+  const auto bufferViewIdx = jsonImage.value("bufferView", -1);
+  const auto &uri = getStringRef(jsonImage, "uri");
+
+  if (bufferViewIdx >= 0) {
+    if (!jsonBufferViews || size_t(bufferViewIdx) >= jsonBufferViews->size()) {
+      err += "Invalid bufferView for image " + std::to_string(imageIdx) +
+             ".\n";
+      return false;
+    }
+    const auto &jsonBufferView = (*jsonBufferViews)[bufferViewIdx];
+    const auto bufferIdx = jsonBufferView.value("buffer", -1);
+    const auto byteOffset = jsonBufferView.value("byteOffset", size_t(0));
+    const auto byteLength = jsonBufferView.value("byteLength", size_t(0));
+    if (bufferIdx < 0 || size_t(bufferIdx) >= buffers.spans.size() ||
+        byteOffset + byteLength > buffers.spans[bufferIdx].size) {
+      err += "Invalid bufferView for image " + std::to_string(imageIdx) +
+             ".\n";
+      return false;
+    }
+    source = ByteSpan{buffers.spans[bufferIdx].data + byteOffset, byteLength};
+  } else if (isDataUri(uri)) {
+    std::string mimeType;
+    if (!decodeDataUri(uri, buffers, mimeType)) {
+      err += "Failed to decode data URI of image " + std::to_string(imageIdx) +
+             ".\n";
+      return false;
+    }
+    const auto &data = buffers.ownedData.back();
+    source = ByteSpan{data.data(), data.size()};
+    jsonImage["mimeType"] = mimeType;
+  } else if (!uri.empty()) {
+    try {
+      buffers.mappedFiles.emplace_back(baseDir / uri);
+      const auto &file = buffers.mappedFiles.back();
+      source = ByteSpan{file.data(), file.size()};
+    } catch (const std::runtime_error &) {
+    }
+  }
+  return true;
+}
+
+struct ImageLoaderContext
+{
+  const std::vector<ByteSpan> &imageSources;
+  bool decodeImages;
+};
+
+// Image loader callback: images are decoded from the bytes resolved by
+// resolveImage() instead of the stub tinygltf sees, or not decoded at all if
+// decoding is deferred
+bool loadImageData(tinygltf::Image *image, const int imageIdx, std::string *err,
+    std::string *warn, int reqWidth, int reqHeight, const unsigned char *bytes,
+    int size, void *userData)
+{
+  const auto &context = *static_cast<const ImageLoaderContext *>(userData);
+  const auto &imageSources = context.imageSources;
+  if (size_t(imageIdx) < imageSources.size() && imageSources[imageIdx].data) {
+    if (!context.decodeImages) {
+      return true;
+    }
+    bytes = imageSources[imageIdx].data;
+    size = int(imageSources[imageIdx].size);
+  }
+  return tinygltf::LoadImageData(
+      image, imageIdx, err, warn, reqWidth, reqHeight, bytes, size, nullptr);
+}
+
+} // namespace
+
+ByteSpan getBufferViewBytes(const tinygltf::Model &model,
+    const GltfBuffers &buffers, int bufferViewIdx)
+{
+  const auto &bufferView = model.bufferViews[bufferViewIdx];
+  const auto &buffer = buffers.spans[bufferView.buffer];
+  return ByteSpan{buffer.data + bufferView.byteOffset, bufferView.byteLength};
+}
+
+ByteSpan getImagePixels(const tinygltf::Model &model,
+    const GltfBuffers &buffers, int imageIdx)
+{
+  const auto &pixels = model.images[imageIdx].image;
+  if (pixels.empty() && size_t(imageIdx) < buffers.decodedImages.size()) {
+    return buffers.decodedImages[imageIdx];
+  }
+  return ByteSpan{pixels.data(), pixels.size()};
+}
+
+bool loadGltf(const fs::path &path, tinygltf::Model &model,
+    GltfBuffers &buffers, std::string &err, std::string &warn,
+    bool decodeImages)
+{
+  MappedFile file;
+  try {
+    file = MappedFile(path);
+  } catch (const std::runtime_error &e) {
+    err += std::string(e.what()) + "\n";
+    return false;
+  }
+
+  ByteSpan jsonChunk{file.data(), file.size()};
+  ByteSpan binChunk;
+  if (file.size() >= 4 && readUint32(file.data()) == GLB_MAGIC) {
+    jsonChunk = ByteSpan{};
+    if (!parseGlbChunks(file, jsonChunk, binChunk, err)) {
+      return false;
+    }
+  }
+
+  auto document = nlohmann::json::parse(
+      jsonChunk.data, jsonChunk.data + jsonChunk.size, nullptr, false);
+  if (document.is_discarded() || !document.is_object()) {
+    err += "Failed to parse glTF JSON.\n";
+    return false;
+  }
+
+  const auto baseDir = path.parent_path();
+  buffers = GltfBuffers{};
+
+  // Resolve every buffer ourselves, then replace it by a one byte stub
+  std::vector<std::string> bufferUris;
+  auto jsonBuffers = document.find("buffers");
+  if (jsonBuffers != document.end() && jsonBuffers->is_array()) {
+    buffers.spans.reserve(jsonBuffers->size());
+    for (auto &jsonBuffer : *jsonBuffers) {
+      if (!resolveBuffer(jsonBuffer, buffers.spans.size(), baseDir, binChunk,
+              buffers, err)) {
+        return false;
+      }
+      const auto &uri = getStringRef(jsonBuffer, "uri");
+      bufferUris.push_back(isDataUri(uri) ? std::string() : uri);
+      jsonBuffer["uri"] = STUB_BUFFER_URI;
+      jsonBuffer["byteLength"] = 1;
+    }
+  }
+
+  // Resolve the bytes of every image as well: tinygltf only sees a one byte
+  // stub bufferView and the image loader callback gets the real bytes.
+  // Original bufferViews and uris are restored after parsing.
+  auto &imageSources = buffers.encodedImages;
+  std::vector<int> imageBufferViews;
+  std::vector<std::string> imageUris;
+  bool hasImageStubs = false;
+  auto jsonImages = document.find("images");
+  if (jsonImages != document.end() && jsonImages->is_array()) {
+    auto jsonBufferViews = document.find("bufferViews");
+    const auto *pJsonBufferViews =
+        jsonBufferViews != document.end() && jsonBufferViews->is_array()
+            ? &*jsonBufferViews
+            : nullptr;
+    const auto stubBufferViewIdx =
+        pJsonBufferViews ? int(pJsonBufferViews->size()) : 0;
+    const auto stubBufferIdx = int(bufferUris.size());
+
+    for (auto &jsonImage : *jsonImages) {
+      ByteSpan source;
+      if (!resolveImage(jsonImage, imageSources.size(), pJsonBufferViews,
+              baseDir, buffers, source, err)) {
+        return false;
+      }
+      const auto &uri = getStringRef(jsonImage, "uri");
+      imageBufferViews.push_back(jsonImage.value("bufferView", -1));
+      imageUris.push_back(isDataUri(uri) ? std::string() : uri);
+      imageSources.push_back(source);
+      if (source.data) {
+        jsonImage.erase("uri");
+        jsonImage["bufferView"] = stubBufferViewIdx;
+      }
+    }
+
+    document["bufferViews"].push_back(
+        {{"buffer", stubBufferIdx}, {"byteLength", 1}});
+    document["buffers"].push_back(
+        {{"uri", STUB_BUFFER_URI}, {"byteLength", 1}});
+    hasImageStubs = true;
+  }
+
+  const auto strippedJson = document.dump();
+  document = nlohmann::json(); // Free the DOM before tinygltf builds its own
+
+  ImageLoaderContext imageLoaderContext{imageSources, decodeImages};
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(loadImageData, &imageLoaderContext);
+  if (!loader.LoadASCIIFromString(&model, &err, &warn, strippedJson.c_str(),
+          (unsigned int)strippedJson.size(), baseDir.string())) {
+    return false;
+  }
+
+  // Restore what was patched for tinygltf
+  if (hasImageStubs) {
+    model.bufferViews.pop_back();
+    model.buffers.pop_back();
+    for (size_t i = 0; i < model.images.size(); ++i) {
+      model.images[i].bufferView = imageBufferViews[i];
+      model.images[i].uri = imageUris[i];
+    }
+  }
+  for (size_t i = 0; i < model.buffers.size(); ++i) {
+    model.buffers[i].uri = bufferUris[i];
+    model.buffers[i].data.clear();
+  }
+
+  if (binChunk.data) {
+    buffers.mappedFiles.emplace_back(std::move(file));
+  }
+
+  return true;
+}
+
+size_t releaseUploadedData(tinygltf::Model &model, GltfBuffers &buffers)
+{
+  size_t releasedBytes = 0;
+  for (const auto &file : buffers.mappedFiles) {
+    releasedBytes += file.size();
+  }
+  for (const auto &data : buffers.ownedData) {
+    releasedBytes += data.size();
+  }
+  buffers = GltfBuffers{};
+
+  for (auto &buffer : model.buffers) {
+    releasedBytes += buffer.data.size();
+    std::vector<unsigned char>().swap(buffer.data);
+  }
+  for (auto &image : model.images) {
+    releasedBytes += image.image.size();
+    std::vector<unsigned char>().swap(image.image);
+  }
+
+  // Never used by the viewer
+  model.animations.clear();
+  model.skins.clear();
+
+  return releasedBytes;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "mapped_file.hpp"
+
+#include <tiny_gltf.h>
+
+#include <string>
+#include <vector>
+
+// Contiguous read-only bytes owned by someone else
+struct ByteSpan
+{
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+};
+
+// Storage for the buffers of a model loaded with loadGltf().
+// tinygltf copies each buffer in tinygltf::Buffer::data; loadGltf() does not:
+// model.buffers[i].data is left empty and spans[i] points directly into the
+// memory-mapped .glb / .bin file (or into a decoded data URI), so the bytes
+// must always be read from here.
+struct GltfBuffers
+{
+  std::vector<ByteSpan> spans; // One per model.buffers, same indices
+  std::vector<MappedFile> mappedFiles; // Keep the mappings alive
+  std::vector<std::vector<unsigned char>> ownedData; // Decoded data URIs
+  // One per model.images: encoded (PNG, JPEG...) bytes of the image, empty if
+  // its file could not be mapped
+  std::vector<ByteSpan> encodedImages;
+  // One per model.images when their texels are loaded from the scene cache,
+  // in which case model.images[i].image is empty. Empty otherwise.
+  std::vector<ByteSpan> decodedImages;
+};
+
+// Bytes referenced by a bufferView
+ByteSpan getBufferViewBytes(const tinygltf::Model &model,
+    const GltfBuffers &buffers, int bufferViewIdx);
+
+// Decoded texels of an image, from model.images[imageIdx].image or from the
+// scene cache mapping
+ByteSpan getImagePixels(const tinygltf::Model &model,
+    const GltfBuffers &buffers, int imageIdx);
+
+// Load a .gltf or .glb file (detected from its magic number), memory-mapping
+// the file itself and every external buffer or image instead of copying them.
+// If decodeImages is false, model.images are left empty and must be decoded
+// from buffers.encodedImages (see ImageDecodeQueue).
+// Return false and fill err on failure.
+bool loadGltf(const fs::path &path, tinygltf::Model &model,
+    GltfBuffers &buffers, std::string &err, std::string &warn,
+    bool decodeImages = true);
+
+// Release the CPU copies of what has been uploaded to the GPU: buffer bytes
+// (unmapping the files), encoded and decoded images. The model keeps the
+// description used to render (scenes, nodes, meshes, accessors, buffer views,
+// materials, textures) but its buffers and images must not be read anymore.
+// Return the number of bytes released.
+size_t releaseUploadedData(tinygltf::Model &model, GltfBuffers &buffers);
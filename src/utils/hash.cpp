@@ -0,0 +1,101 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+namespace
+{
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotateLeft(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char *p)
+{
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t read32(const unsigned char *p)
+{
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t mixRound(uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME2;
+  acc = rotateLeft(acc, 31);
+  return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+{
+  acc ^= mixRound(0, value);
+  return acc * PRIME1 + PRIME4;
+}
+
+} // namespace
+
+// Same structure as XXH64
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+  const auto *p = static_cast<const unsigned char *>(data);
+  const auto *const pEnd = p + size;
+  uint64_t hash;
+
+  if (size >= 32) {
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+    const auto *const pLimit = pEnd - 32;
+    do {
+      v1 = mixRound(v1, read64(p));
+      v2 = mixRound(v2, read64(p + 8));
+      v3 = mixRound(v3, read64(p + 16));
+      v4 = mixRound(v4, read64(p + 24));
+      p += 32;
+    } while (p <= pLimit);
+
+    hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) +
+           rotateLeft(v4, 18);
+    hash = mergeRound(hash, v1);
+    hash = mergeRound(hash, v2);
+    hash = mergeRound(hash, v3);
+    hash = mergeRound(hash, v4);
+  } else {
+    hash = seed + PRIME5;
+  }
+
+  hash += uint64_t(size);
+
+  for (; p + 8 <= pEnd; p += 8) {
+    hash ^= mixRound(0, read64(p));
+    hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+  }
+  if (p + 4 <= pEnd) {
+    hash ^= read32(p) * PRIME1;
+    hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for (; p < pEnd; ++p) {
+    hash ^= (*p) * PRIME5;
+    hash = rotateLeft(hash, 11) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64 bits hash of a byte range, processing 32 bytes per
+// iteration on four independent lanes so that it runs close to memory
+// bandwidth. Not stable across endianness.
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// Mix a value into an existing hash, e.g. to hash structures field by field
+inline uint64_t hashCombine(uint64_t hash, uint64_t value)
+{
+  hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+  return hash;
+}
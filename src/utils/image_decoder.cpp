@@ -0,0 +1,88 @@
+#include "image_decoder.hpp"
+
+#include <iostream>
+
+ImageDecodeQueue::ImageDecodeQueue(ThreadPool &pool, tinygltf::Model &model,
+    const std::vector<ByteSpan> &encodedImages) :
+    m_remainingCount(model.images.size()),
+    m_start(std::chrono::steady_clock::now())
+{
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto imageIdx = int(i);
+    const auto encoded =
+        i < encodedImages.size() ? encodedImages[i] : ByteSpan{};
+    if (!encoded.data) {
+      m_decoded.push_back(imageIdx);
+      continue;
+    }
+
+    ++m_runningCount;
+    m_stats.encodedBytes += encoded.size;
+    auto *pImage = &model.images[i];
+    pool.enqueue([this, pImage, imageIdx, encoded]() {
+      const auto allocationsBefore = getThreadAllocationCounters();
+      // stb_image only shares its failure reason string between threads
+      std::string err, warn;
+      tinygltf::LoadImageData(pImage, imageIdx, &err, &warn, 0, 0,
+          encoded.data, int(encoded.size), nullptr);
+      const auto allocations =
+          getThreadAllocationCounters() - allocationsBefore;
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!err.empty()) {
+        std::cerr << err;
+      }
+      m_stats.milliseconds = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - m_start)
+                                 .count();
+      m_stats.allocations.count += allocations.count;
+      m_stats.allocations.bytes += allocations.bytes;
+      m_decoded.push_back(imageIdx);
+      --m_runningCount;
+      m_condition.notify_all();
+    });
+  }
+}
+
+ImageDecodeQueue::~ImageDecodeQueue()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_condition.wait(lock, [this]() { return m_runningCount == 0; });
+}
+
+int ImageDecodeQueue::pop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_remainingCount == 0) {
+    return -1;
+  }
+  m_condition.wait(lock, [this]() { return !m_decoded.empty(); });
+  const auto imageIdx = m_decoded.front();
+  m_decoded.pop_front();
+  --m_remainingCount;
+  return imageIdx;
+}
+
+int ImageDecodeQueue::tryPop()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_decoded.empty()) {
+    return -1;
+  }
+  const auto imageIdx = m_decoded.front();
+  m_decoded.pop_front();
+  --m_remainingCount;
+  return imageIdx;
+}
+
+bool ImageDecodeQueue::done() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_remainingCount == 0;
+}
+
+ImageDecodeQueue::Stats ImageDecodeQueue::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "allocation_counter.hpp"
+#include "gltf_loader.hpp"
+#include "thread_pool.hpp"
+
+#include <tiny_gltf.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Decode the images of a model on a thread pool. Workers write the pixels in
+// model.images[i] and the GL thread pops the index of each image as soon as it
+// is ready to be uploaded. model.images[i] must not be accessed by the caller
+// before i has been popped.
+class ImageDecodeQueue
+{
+public:
+  // encodedImages[i] holds the encoded (PNG, JPEG...) bytes of
+  // model.images[i], see loadGltf(). Images with an empty span are popped
+  // right away, untouched.
+  ImageDecodeQueue(ThreadPool &pool, tinygltf::Model &model,
+      const std::vector<ByteSpan> &encodedImages);
+
+  // Wait for the running tasks since they write in the model
+  ~ImageDecodeQueue();
+
+  // Non-copyable class:
+  ImageDecodeQueue(const ImageDecodeQueue &) = delete;
+  ImageDecodeQueue &operator=(const ImageDecodeQueue &) = delete;
+
+  // Block until an image is decoded and return its index, or return -1 once
+  // every image has been popped
+  int pop();
+
+  // Same as pop() without blocking: return -1 if no image is ready yet
+  int tryPop();
+
+  // True once every image has been popped
+  bool done() const;
+
+  // Measured over the decoding tasks, complete once done()
+  struct Stats
+  {
+    double milliseconds = 0; // From construction to the last decoded image
+    size_t encodedBytes = 0;
+    AllocationCounters allocations; // Made by the decoding tasks
+  };
+  Stats stats() const;
+
+private:
+  std::deque<int> m_decoded;
+  size_t m_remainingCount = 0; // Not popped yet
+  size_t m_runningCount = 0; // Tasks not finished yet
+  mutable std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::chrono::steady_clock::time_point m_start;
+  Stats m_stats;
+};
@@ -0,0 +1,74 @@
+#include "load_report.hpp"
+
+#include <json.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+LoadReport::LoadReport() :
+    m_start(Clock::now()), m_end(m_start), m_stageStart(m_start)
+{
+}
+
+void LoadReport::beginStage(const std::string &name)
+{
+  m_stages.emplace_back();
+  m_stages.back().name = name;
+  m_stageAllocations = getThreadAllocationCounters();
+  m_stageStart = Clock::now();
+}
+
+void LoadReport::endStage(size_t bytes)
+{
+  m_end = Clock::now();
+  auto &stage = m_stages.back();
+  stage.milliseconds =
+      std::chrono::duration<double, std::milli>(m_end - m_stageStart).count();
+  stage.bytes = bytes;
+  stage.allocations = getThreadAllocationCounters() - m_stageAllocations;
+}
+
+void LoadReport::addStage(const Stage &stage) { m_stages.push_back(stage); }
+
+double LoadReport::totalMilliseconds() const
+{
+  return std::chrono::duration<double, std::milli>(m_end - m_start).count();
+}
+
+double LoadReport::markMilliseconds()
+{
+  m_end = Clock::now();
+  return totalMilliseconds();
+}
+
+void LoadReport::print(std::ostream &out) const
+{
+  char line[256];
+  for (const auto &stage : m_stages) {
+    std::snprintf(line, sizeof(line),
+        "  %-28s %9.2f ms %10.2f MiB %8zu allocations%s\n",
+        stage.name.c_str(), stage.milliseconds,
+        double(stage.bytes) / (1 << 20), stage.allocations.count,
+        stage.async ? " (async)" : "");
+    out << line;
+  }
+  std::snprintf(line, sizeof(line), "  %-28s %9.2f ms\n", "total",
+      totalMilliseconds());
+  out << line;
+}
+
+bool LoadReport::writeJson(const fs::path &path) const
+{
+  nlohmann::json stages = nlohmann::json::array();
+  for (const auto &stage : m_stages) {
+    stages.push_back({{"name", stage.name}, {"ms", stage.milliseconds},
+        {"bytes", stage.bytes}, {"allocations", stage.allocations.count},
+        {"allocatedBytes", stage.allocations.bytes}, {"async", stage.async}});
+  }
+  const nlohmann::json report = {
+      {"totalMs", totalMilliseconds()}, {"stages", stages}};
+
+  std::ofstream out{path.string()};
+  out << report.dump(2) << std::endl;
+  return bool(out);
+}
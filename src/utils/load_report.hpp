@@ -0,0 +1,55 @@
+#pragma once
+
+#include "allocation_counter.hpp"
+#include "filesystem.hpp"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Wall time, bytes processed and allocations of each stage of the loading,
+// measured on the calling thread between beginStage() and endStage()
+class LoadReport
+{
+public:
+  struct Stage
+  {
+    std::string name;
+    double milliseconds = 0;
+    size_t bytes = 0; // Amount of data processed, 0 if not meaningful
+    AllocationCounters allocations;
+    // Ran on worker threads, overlapping the stages of the calling thread
+    bool async = false;
+  };
+
+  LoadReport();
+
+  void beginStage(const std::string &name);
+  void endStage(size_t bytes = 0);
+
+  // Add a stage measured elsewhere, e.g. by worker threads
+  void addStage(const Stage &stage);
+
+  // Wall time from construction to the last endStage() or
+  // markMilliseconds()
+  double totalMilliseconds() const;
+
+  // Wall time from construction to now, which becomes the end of the loading,
+  // e.g. to time work spread over frames
+  double markMilliseconds();
+
+  void print(std::ostream &out) const;
+
+  // Return false on failure
+  bool writeJson(const fs::path &path) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<Stage> m_stages;
+  Clock::time_point m_start;
+  Clock::time_point m_end;
+  Clock::time_point m_stageStart;
+  AllocationCounters m_stageAllocations;
+};
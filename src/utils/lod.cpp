@@ -0,0 +1,277 @@
+#include "lod.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+// Primitives with fewer triangles are drawn as they are
+const size_t MIN_SIMPLIFIED_TRIANGLE_COUNT = 64;
+// Grid resolutions tried along the largest axis of a primitive, finest first
+const int CLUSTER_GRID_SIZES[] = {256, 128, 64, 32, 16, 8, 4};
+
+float getMaxScale(const glm::mat4 &matrix)
+{
+  const auto x = glm::vec3(matrix[0]);
+  const auto y = glm::vec3(matrix[1]);
+  const auto z = glm::vec3(matrix[2]);
+  return std::sqrt(
+      std::max({glm::dot(x, x), glm::dot(y, y), glm::dot(z, z)}));
+}
+
+} // namespace
+
+std::vector<uint32_t> simplifyByClustering(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices, float cellSize)
+{
+  // Cell of each referenced vertex, sorted to group the vertices by cell
+  Bounds bounds;
+  std::vector<bool> isReferenced(positions.size(), false);
+  for (const auto index : indices) {
+    isReferenced[index] = true;
+    bounds.extend({positions[index], positions[index]});
+  }
+  std::vector<std::pair<uint64_t, uint32_t>> cells;
+  for (uint32_t vertex = 0; vertex < positions.size(); ++vertex) {
+    if (!isReferenced[vertex]) {
+      continue;
+    }
+    const auto cell = (positions[vertex] - bounds.min) / cellSize;
+    cells.emplace_back(uint64_t(cell.x) | (uint64_t(cell.y) << 21) |
+                           (uint64_t(cell.z) << 42),
+        vertex);
+  }
+  std::sort(begin(cells), end(cells));
+
+  // The representative of a cell is its vertex the closest to their mean
+  std::vector<uint32_t> remap(positions.size());
+  for (size_t first = 0; first < cells.size();) {
+    auto last = first;
+    glm::vec3 mean(0);
+    for (; last < cells.size() && cells[last].first == cells[first].first;
+         ++last) {
+      mean += positions[cells[last].second];
+    }
+    mean /= float(last - first);
+    auto representative = cells[first].second;
+    auto minDistance = std::numeric_limits<float>::max();
+    for (auto i = first; i < last; ++i) {
+      const auto offset = positions[cells[i].second] - mean;
+      const auto distance = glm::dot(offset, offset);
+      if (distance < minDistance) {
+        minDistance = distance;
+        representative = cells[i].second;
+      }
+    }
+    for (auto i = first; i < last; ++i) {
+      remap[cells[i].second] = representative;
+    }
+    first = last;
+  }
+
+  // Triangles rotated to start with their smallest index, keeping their
+  // winding, so that duplicates are adjacent once sorted
+  std::vector<std::array<uint32_t, 3>> triangles;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    std::array<uint32_t, 3> triangle{
+        remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]]};
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+        triangle[2] == triangle[0]) {
+      continue;
+    }
+    std::rotate(begin(triangle),
+        std::min_element(begin(triangle), end(triangle)), end(triangle));
+    triangles.push_back(triangle);
+  }
+  std::sort(begin(triangles), end(triangles));
+  triangles.erase(
+      std::unique(begin(triangles), end(triangles)), end(triangles));
+
+  std::vector<uint32_t> simplified;
+  simplified.reserve(3 * triangles.size());
+  for (const auto &triangle : triangles) {
+    simplified.insert(end(simplified), begin(triangle), end(triangle));
+  }
+  return simplified;
+}
+
+LodChains buildLodChains(const tinygltf::Model &model,
+    const GltfBuffers &buffers, size_t maxLevelCount)
+{
+  LodChains lods;
+  lods.meshes.resize(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    lods.meshes[meshIdx].resize(primitives.size());
+    for (size_t primIdx = 0; primIdx < primitives.size(); ++primIdx) {
+      const auto &primitive = primitives[primIdx];
+      const auto positionIt = primitive.attributes.find("POSITION");
+      if ((primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode >= 0) ||
+          primitive.indices < 0 || positionIt == end(primitive.attributes)) {
+        continue;
+      }
+      const auto &indexAccessor = model.accessors[primitive.indices];
+      const auto &positionAccessor = model.accessors[positionIt->second];
+      if (indexAccessor.bufferView < 0 ||
+          indexAccessor.count / 3 < MIN_SIMPLIFIED_TRIANGLE_COUNT ||
+          positionAccessor.type != TINYGLTF_TYPE_VEC3 ||
+          positionAccessor.bufferView < 0) {
+        continue;
+      }
+      const auto indices = readIndices(model, buffers, indexAccessor);
+      const auto positions = readPositions(model, buffers, positionAccessor);
+      if (std::any_of(begin(indices), end(indices),
+              [&](uint32_t index) { return index >= positions.size(); })) {
+        continue;
+      }
+
+      Bounds bounds;
+      for (const auto index : indices) {
+        bounds.extend({positions[index], positions[index]});
+      }
+      const auto extent = bounds.max - bounds.min;
+      const auto maxExtent = std::max({extent.x, extent.y, extent.z});
+      if (!(maxExtent > 0.f)) {
+        continue;
+      }
+
+      auto &levels = lods.meshes[meshIdx][primIdx];
+      auto previousCount = indices.size();
+      for (const auto gridSize : CLUSTER_GRID_SIZES) {
+        if (levels.size() >= maxLevelCount) {
+          break;
+        }
+        const auto cellSize = maxExtent / float(gridSize);
+        const auto simplified =
+            simplifyByClustering(positions, indices, cellSize);
+        if (simplified.empty()) {
+          break;
+        }
+        if (4 * simplified.size() > 3 * previousCount) {
+          continue; // Not simplified enough to be worth a level
+        }
+        LodLevel level;
+        level.firstIndex = lods.indices.size();
+        level.indexCount = simplified.size();
+        // A vertex moves at most to the opposite corner of its cell
+        level.error = cellSize * std::sqrt(3.f);
+        levels.push_back(level);
+        lods.indices.insert(
+            end(lods.indices), begin(simplified), end(simplified));
+        previousCount = simplified.size();
+      }
+    }
+  }
+  return lods;
+}
+
+void packLodIndices(LodChains &lods, const tinygltf::Model &model,
+    CompactBufferLayout &bufferLayout)
+{
+  for (size_t meshIdx = 0; meshIdx < lods.meshes.size(); ++meshIdx) {
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    for (size_t primIdx = 0; primIdx < primitives.size(); ++primIdx) {
+      auto &levels = lods.meshes[meshIdx][primIdx];
+      if (levels.empty()) {
+        continue;
+      }
+      const auto &indexAccessor =
+          model.accessors[primitives[primIdx].indices];
+      auto &bufferSize = bufferLayout.bufferSizes
+          [model.bufferViews[indexAccessor.bufferView].buffer];
+      for (auto &level : levels) {
+        bufferSize = (bufferSize + 3) / 4 * 4;
+        level.byteOffset = ptrdiff_t(bufferSize);
+        bufferSize += level.indexCount * sizeof(uint32_t);
+      }
+    }
+  }
+}
+
+size_t selectLods(const LodChains &lods, const tinygltf::Model &model,
+    const PrimitiveInstances &instances, const FlatSceneGraph &graph,
+    const glm::vec3 &eye, float pixelsPerUnit, float maxPixelError,
+    const std::vector<uint8_t> &visible, std::vector<uint8_t> &levels)
+{
+  levels.assign(instances.size(), 0);
+  size_t triangleCount = 0;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    if (!visible[i]) {
+      continue;
+    }
+    const auto meshIdx = instances.meshes[i];
+    const auto primIdx = instances.primitives[i];
+    const auto &chain = lods.meshes[meshIdx][primIdx];
+    const auto &primitive = model.meshes[meshIdx].primitives[primIdx];
+    if (chain.empty()) {
+      if (primitive.indices >= 0) {
+        triangleCount += model.accessors[primitive.indices].count / 3;
+      } else if (!primitive.attributes.empty()) {
+        triangleCount +=
+            model.accessors[begin(primitive.attributes)->second].count / 3;
+      }
+      continue;
+    }
+
+    // Nearest distance to the bounding sphere: the error is projected where
+    // it is the largest
+    const glm::vec3 center(
+        instances.centersX[i], instances.centersY[i], instances.centersZ[i]);
+    const auto distance = glm::length(center - eye) - instances.radii[i];
+    size_t level = 0;
+    if (distance > 0.f) {
+      const auto pixelsPerError =
+          getMaxScale(getWorldMatrix(instances, graph, i)) *
+          pixelsPerUnit / distance;
+      while (level < chain.size() &&
+             chain[level].error * pixelsPerError <= maxPixelError) {
+        ++level;
+      }
+    }
+    levels[i] = uint8_t(level);
+    triangleCount += level ? chain[level - 1].indexCount / 3
+                           : model.accessors[primitive.indices].count / 3;
+  }
+  return triangleCount;
+}
+
+size_t selectMsftLods(const PrimitiveInstances &instances, const glm::vec3 &eye,
+    float projectionScale, std::vector<uint8_t> &visible)
+{
+  size_t clearedCount = 0;
+  for (size_t first = 0; first < instances.size();) {
+    // The instances of a node, all levels included
+    auto last = first;
+    auto hasLevels = false;
+    Bounds bounds;
+    for (; last < instances.size() &&
+           instances.nodes[last] == instances.nodes[first];
+         ++last) {
+      hasLevels = hasLevels || instances.msftLodLevels[last] > 0;
+      bounds.extend(instances.worldBounds[last]);
+    }
+    if (hasLevels && !bounds.empty()) {
+      // Projected diameter of the bounding sphere over the viewport height
+      const auto radius = glm::length(bounds.max - bounds.min) * 0.5f;
+      const auto distance =
+          glm::length((bounds.min + bounds.max) * 0.5f - eye);
+      const auto coverage = distance > radius
+                                ? radius * projectionScale / distance
+                                : std::numeric_limits<float>::max();
+      for (auto i = first; i < last; ++i) {
+        if (visible[i] && (coverage < instances.minScreenCoverages[i] ||
+                              coverage >= instances.maxScreenCoverages[i])) {
+          visible[i] = 0;
+          ++clearedCount;
+        }
+      }
+    }
+    first = last;
+  }
+  return clearedCount;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "culling.hpp"
+#include "gltf.hpp"
+#include "gltf_loader.hpp"
+#include "scene_graph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Simplified index buffer of a primitive, reusing its vertices
+struct LodLevel
+{
+  size_t firstIndex = 0; // In LodChains::indices
+  size_t indexCount = 0;
+  float error = 0; // Largest vertex displacement, in mesh units
+  ptrdiff_t byteOffset = -1; // In the GPU buffer, see packLodIndices()
+};
+
+// Levels of detail generated for each primitive, indexed by mesh then
+// primitive, from the finest to the coarsest. Level 0, the primitive itself,
+// is not listed. Every level stores 32-bit indices in indices.
+struct LodChains
+{
+  std::vector<std::vector<std::vector<LodLevel>>> meshes;
+  std::vector<uint32_t> indices;
+};
+
+// Remap each vertex of indices to a representative vertex of its cell in a
+// grid of cellSize, then drop the triangles left degenerate or duplicated
+// (vertex clustering)
+std::vector<uint32_t> simplifyByClustering(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices, float cellSize);
+
+// Generate up to maxLevelCount levels for the indexed triangle primitives with
+// VEC3 positions, each level having at most 3 / 4 of the triangles of the
+// previous one
+LodChains buildLodChains(const tinygltf::Model &model,
+    const GltfBuffers &buffers, size_t maxLevelCount);
+
+// Append the level indices to the GPU buffer holding the indices of their
+// primitive, so that they are drawn with the vertex array object of the
+// primitive, and set their byteOffset
+void packLodIndices(LodChains &lods, const tinygltf::Model &model,
+    CompactBufferLayout &bufferLayout);
+
+// For each visible instance, set levels[i] to the coarsest level of detail of
+// its primitive whose error projects to at most maxPixelError pixels, seen
+// from eye. pixelsPerUnit is the size in pixels of a unit at a distance of 1
+// (viewport height * projMatrix[1][1] / 2). Return the number of triangles
+// of the selected levels.
+size_t selectLods(const LodChains &lods, const tinygltf::Model &model,
+    const PrimitiveInstances &instances, const FlatSceneGraph &graph,
+    const glm::vec3 &eye, float pixelsPerUnit, float maxPixelError,
+    const std::vector<uint8_t> &visible, std::vector<uint8_t> &levels);
+
+// Clear visible[i] for the instances of nodes with MSFT_lod levels whose
+// screen coverage range does not contain the screen coverage of their node.
+// projectionScale is projMatrix[1][1]. Return the number of instances cleared.
+size_t selectMsftLods(const PrimitiveInstances &instances, const glm::vec3 &eye,
+    float projectionScale, std::vector<uint8_t> &visible);
@@ -0,0 +1,110 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const fs::path &path)
+{
+#ifdef _WIN32
+  const auto hFile = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+      FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+      nullptr);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Unable to open file " + path.string());
+  }
+  m_hFile = hFile;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(hFile, &fileSize)) {
+    release();
+    throw std::runtime_error("Unable to get size of file " + path.string());
+  }
+  m_size = size_t(fileSize.QuadPart);
+  if (m_size == 0) {
+    return; // Empty files cannot be mapped
+  }
+
+  m_hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_hMapping) {
+    release();
+    throw std::runtime_error("Unable to map file " + path.string());
+  }
+  m_pData = static_cast<const unsigned char *>(
+      MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+  if (!m_pData) {
+    release();
+    throw std::runtime_error("Unable to map file " + path.string());
+  }
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open file " + path.string());
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    close(fd);
+    throw std::runtime_error("Unable to get size of file " + path.string());
+  }
+  m_size = size_t(fileStat.st_size);
+  if (m_size == 0) {
+    close(fd);
+    return; // Empty files cannot be mapped
+  }
+
+  void *pData = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps its own reference on the file
+  if (pData == MAP_FAILED) {
+    m_size = 0;
+    throw std::runtime_error("Unable to map file " + path.string());
+  }
+  m_pData = static_cast<const unsigned char *>(pData);
+#endif
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&rvalue)
+{
+  if (this != &rvalue) {
+    release();
+    std::swap(m_pData, rvalue.m_pData);
+    std::swap(m_size, rvalue.m_size);
+#ifdef _WIN32
+    std::swap(m_hFile, rvalue.m_hFile);
+    std::swap(m_hMapping, rvalue.m_hMapping);
+#endif
+  }
+  return *this;
+}
+
+void MappedFile::release()
+{
+#ifdef _WIN32
+  if (m_pData) {
+    UnmapViewOfFile(m_pData);
+  }
+  if (m_hMapping) {
+    CloseHandle(m_hMapping);
+  }
+  if (m_hFile) {
+    CloseHandle(m_hFile);
+  }
+  m_hFile = nullptr;
+  m_hMapping = nullptr;
+#else
+  if (m_pData) {
+    munmap(const_cast<unsigned char *>(m_pData), m_size);
+  }
+#endif
+  m_pData = nullptr;
+  m_size = 0;
+}
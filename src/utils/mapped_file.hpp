@@ -0,0 +1,43 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <utility>
+
+// Read-only memory mapping of a whole file. Pages are loaded lazily by the OS
+// and the mapping is released when the object is destroyed.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  // Throws std::runtime_error if the file cannot be opened or mapped
+  explicit MappedFile(const fs::path &path);
+
+  ~MappedFile() { release(); }
+
+  // Non-copyable class:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&rvalue) { *this = std::move(rvalue); }
+
+  MappedFile &operator=(MappedFile &&rvalue);
+
+  const unsigned char *data() const { return m_pData; }
+
+  size_t size() const { return m_size; }
+
+  bool empty() const { return m_size == 0; }
+
+private:
+  void release();
+
+  const unsigned char *m_pData = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_hFile = nullptr;
+  void *m_hMapping = nullptr;
+#endif
+};
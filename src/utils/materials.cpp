@@ -0,0 +1,51 @@
+#include "materials.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+MaterialData getMaterialData(const tinygltf::Material &material)
+{
+  const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
+  // Factor arrays are only filled with their defaults by the parser
+  MaterialData data{};
+  data.baseColorFactor = glm::vec4(1.f);
+  const auto &baseColorFactor = pbrMetallicRoughness.baseColorFactor;
+  for (size_t i = 0; i < std::min(baseColorFactor.size(), size_t(4)); ++i) {
+    data.baseColorFactor[i] = float(baseColorFactor[i]);
+  }
+  const auto &emissiveFactor = material.emissiveFactor;
+  for (size_t i = 0; i < std::min(emissiveFactor.size(), size_t(3)); ++i) {
+    data.emissiveFactor[i] = float(emissiveFactor[i]);
+  }
+  data.metallicFactor = float(pbrMetallicRoughness.metallicFactor);
+  data.roughnessFactor = float(pbrMetallicRoughness.roughnessFactor);
+  data.occlusionStrength = float(material.occlusionTexture.strength);
+  return data;
+}
+
+} // namespace
+
+MaterialBuffer packMaterials(const tinygltf::Model &model, size_t alignment)
+{
+  MaterialBuffer buffer;
+  alignment = std::max(alignment, size_t(1));
+  buffer.stride =
+      (sizeof(MaterialData) + alignment - 1) / alignment * alignment;
+  buffer.bytes.resize(buffer.stride * (model.materials.size() + 1), 0);
+  for (size_t i = 0; i < model.materials.size(); ++i) {
+    const auto data = getMaterialData(model.materials[i]);
+    std::memcpy(buffer.bytes.data() + i * buffer.stride, &data, sizeof(data));
+  }
+
+  // White, fully metallic and rough, without emission nor occlusion
+  MaterialData defaultData{};
+  defaultData.baseColorFactor = glm::vec4(1.f);
+  defaultData.metallicFactor = 1.f;
+  defaultData.roughnessFactor = 1.f;
+  std::memcpy(buffer.bytes.data() + model.materials.size() * buffer.stride,
+      &defaultData, sizeof(defaultData));
+  return buffer;
+}
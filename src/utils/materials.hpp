@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <vector>
+
+// Factors of a material as read by the Material uniform block of the
+// shaders, in std140 layout
+struct MaterialData
+{
+  glm::vec4 baseColorFactor;
+  glm::vec3 emissiveFactor;
+  float metallicFactor; // Packed after the vec3, as std140 does
+  float roughnessFactor;
+  float occlusionStrength;
+  float padding[2]; // The size of a block is rounded to a multiple of 16
+};
+static_assert(sizeof(MaterialData) == 48, "MaterialData must match std140");
+
+// Material data of a model converted once to floats, ready to be uploaded in
+// one uniform buffer: one MaterialData per model.materials, then the default
+// material used by primitives without one, each starting at a multiple of
+// stride
+struct MaterialBuffer
+{
+  std::vector<unsigned char> bytes;
+  size_t stride = 0; // sizeof(MaterialData) rounded up to the alignment
+
+  size_t offset(int materialIdx, const tinygltf::Model &model) const
+  {
+    return stride * (materialIdx >= 0 ? size_t(materialIdx)
+                                      : model.materials.size());
+  }
+};
+
+// alignment is GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so that each material can
+// be bound as a range of the buffer
+MaterialBuffer packMaterials(const tinygltf::Model &model, size_t alignment);
@@ -0,0 +1,92 @@
+#include "mesh_arena.hpp"
+#include "accessor_view.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace
+{
+
+// Vectors of attribute name of primitive, vertexCount zeros if it is missing
+// or of another size
+template <glm::length_t N>
+std::vector<glm::vec<N, float>> readAttribute(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Primitive &primitive,
+    const char *name, size_t vertexCount)
+{
+  const auto it = primitive.attributes.find(name);
+  if (it != end(primitive.attributes)) {
+    auto vectors = readVectors<N>(model, buffers, model.accessors[it->second]);
+    if (vectors.size() == vertexCount) {
+      return vectors;
+    }
+  }
+  return std::vector<glm::vec<N, float>>(vertexCount, glm::vec<N, float>(0));
+}
+
+} // namespace
+
+MeshArena buildMeshArena(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const LodChains &lods)
+{
+  MeshArena arena;
+  arena.ranges.resize(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    arena.ranges[meshIdx].resize(primitives.size());
+    for (size_t primIdx = 0; primIdx < primitives.size(); ++primIdx) {
+      const auto &primitive = primitives[primIdx];
+      const auto positionIt = primitive.attributes.find("POSITION");
+      if ((primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode >= 0) ||
+          positionIt == end(primitive.attributes)) {
+        continue;
+      }
+      const auto positions = readPositions(
+          model, buffers, model.accessors[positionIt->second]);
+      std::vector<uint32_t> indices;
+      if (primitive.indices >= 0) {
+        indices =
+            readIndices(model, buffers, model.accessors[primitive.indices]);
+      } else {
+        indices.resize(positions.size());
+        std::iota(begin(indices), end(indices), 0u);
+      }
+      if (positions.empty() || indices.empty() ||
+          *std::max_element(begin(indices), end(indices)) >=
+              positions.size()) {
+        std::cerr << "Primitive " << primIdx << " of mesh " << meshIdx
+                  << " left out of the mesh arena" << std::endl;
+        continue;
+      }
+
+      const auto vertexCount = positions.size();
+      const auto normals =
+          readAttribute<3>(model, buffers, primitive, "NORMAL", vertexCount);
+      const auto texCoords = readAttribute<2>(
+          model, buffers, primitive, "TEXCOORD_0", vertexCount);
+      const auto tangents =
+          readAttribute<4>(model, buffers, primitive, "TANGENT", vertexCount);
+      const auto baseVertex = int32_t(arena.vertices.size());
+      for (size_t i = 0; i < vertexCount; ++i) {
+        arena.vertices.push_back(MeshArena::Vertex{
+            positions[i], normals[i], texCoords[i], tangents[i]});
+      }
+
+      auto &levels = arena.ranges[meshIdx][primIdx];
+      const auto appendLevel = [&](const uint32_t *levelIndices,
+                                   size_t indexCount) {
+        levels.push_back(MeshArena::Range{uint32_t(arena.indices.size()),
+            uint32_t(indexCount), baseVertex});
+        arena.indices.insert(
+            end(arena.indices), levelIndices, levelIndices + indexCount);
+      };
+      appendLevel(indices.data(), indices.size());
+      for (const auto &level : lods.meshes[meshIdx][primIdx]) {
+        appendLevel(lods.indices.data() + level.firstIndex, level.indexCount);
+      }
+    }
+  }
+  return arena;
+}
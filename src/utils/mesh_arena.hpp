@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "lod.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Layout of glDrawElementsIndirect / glMultiDrawElementsIndirect commands
+struct DrawElementsIndirectCommand
+{
+  uint32_t count;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  uint32_t baseInstance;
+};
+
+// Vertices of the triangle primitives converted to one format and appended to
+// shared vertex and index arrays, so that all of them are drawn with one
+// vertex array object and their draws can be merged into one multi-draw.
+// Attributes missing from a primitive are zeros.
+struct MeshArena
+{
+  struct Vertex
+  {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoords;
+    glm::vec4 tangent;
+  };
+
+  // Indices of a level of detail of a primitive, relative to baseVertex
+  struct Range
+  {
+    uint32_t firstIndex = 0; // In indices
+    uint32_t indexCount = 0;
+    int32_t baseVertex = 0; // In vertices
+  };
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  // Indexed by mesh, primitive, then level of detail (0 for the primitive,
+  // then the levels of LodChains). Empty for the primitives left out: the
+  // ones that are not triangles or without VEC3 positions.
+  std::vector<std::vector<std::vector<Range>>> ranges;
+
+  // Range of a level of a primitive, nullptr if left out
+  const Range *find(int meshIdx, int primIdx, int lodLevel) const
+  {
+    const auto &levels = ranges[meshIdx][primIdx];
+    return size_t(lodLevel) < levels.size() ? &levels[lodLevel] : nullptr;
+  }
+};
+
+// Pack the primitives of model and their levels of detail in lods. Indices
+// are widened to 32 bits, non-indexed primitives get sequential indices.
+MeshArena buildMeshArena(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const LodChains &lods);
@@ -0,0 +1,419 @@
+#include "occlusion.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// Occluders smaller than that on screen (bounds diagonal over distance) hide
+// too little to be worth rasterizing
+const float MIN_OCCLUDER_SIZE = 0.1f;
+
+double getMilliseconds(std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+OcclusionBuffer::OcclusionBuffer(ThreadPool &pool, int width, int height) :
+    m_width((std::max(width, 1) + 3) & ~3),
+    m_height(std::max(height, 1)),
+    m_pool(pool)
+{
+  auto size = glm::ivec2(m_width, m_height);
+  for (;;) {
+    m_levelSizes.push_back(size);
+    m_levels.emplace_back(size_t(size.x) * size.y, 1.f);
+    if (size == glm::ivec2(1)) {
+      break;
+    }
+    size = (size + 1) / 2;
+  }
+}
+
+void OcclusionBuffer::clear()
+{
+  m_triangles.clear();
+  std::fill(begin(m_levels[0]), end(m_levels[0]), 1.f);
+}
+
+void OcclusionBuffer::addOccluder(const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices, const glm::mat4 &modelViewProjMatrix)
+{
+  // Vertices in front of the near plane are not projected
+  m_windowPositions.resize(positions.size());
+  std::vector<bool> isProjected(positions.size());
+  const auto halfSize = glm::vec2(m_width, m_height) * 0.5f;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const auto clip = modelViewProjMatrix * glm::vec4(positions[i], 1.f);
+    isProjected[i] = clip.w > 0.f && clip.z >= -clip.w;
+    if (isProjected[i]) {
+      const auto ndc = glm::vec3(clip) / clip.w;
+      m_windowPositions[i] = glm::vec3((glm::vec2(ndc) + 1.f) * halfSize,
+          std::min(ndc.z * 0.5f + 0.5f, 1.f));
+    }
+  }
+
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const auto i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+    if (!isProjected[i0] || !isProjected[i1] || !isProjected[i2]) {
+      continue;
+    }
+    Triangle triangle{{m_windowPositions[i0], m_windowPositions[i1],
+        m_windowPositions[i2]}};
+    auto &v = triangle.vertices;
+    const auto area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+                      (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (std::abs(area) < 1e-6f) {
+      continue;
+    }
+    // Occluders are double sided: both windings hide what is behind them
+    if (area < 0.f) {
+      std::swap(v[1], v[2]);
+    }
+    const auto windowMin = glm::min(v[0], glm::min(v[1], v[2]));
+    const auto windowMax = glm::max(v[0], glm::max(v[1], v[2]));
+    if (windowMax.x < 0.f || windowMax.y < 0.f || windowMin.x > m_width ||
+        windowMin.y > m_height || windowMin.z >= 1.f) {
+      continue;
+    }
+    m_triangles.push_back(triangle);
+  }
+}
+
+void OcclusionBuffer::rasterize()
+{
+  // One band per thread. Each thread claims the next band until none is
+  // left, so the calling thread rasterizes the bands of the workers still
+  // busy with other tasks of the pool instead of waiting for them. The state
+  // is shared with the tasks, which may start after rasterize() returned.
+  struct Bands
+  {
+    std::atomic<int> next{0};
+    int doneCount = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  const auto bandCount = int(m_pool.size()) + 1;
+  const auto bandHeight = (m_height + bandCount - 1) / bandCount;
+  const auto bands = std::make_shared<Bands>();
+  const auto rasterizeBands = [this, bands, bandCount, bandHeight]() {
+    for (auto band = bands->next++; band < bandCount; band = bands->next++) {
+      const auto firstRow = std::min(band * bandHeight, m_height);
+      rasterizeBand(firstRow, std::min(firstRow + bandHeight, m_height));
+      std::lock_guard<std::mutex> lock(bands->mutex);
+      if (++bands->doneCount == bandCount) {
+        bands->condition.notify_all();
+      }
+    }
+  };
+  for (auto band = 1; band < bandCount; ++band) {
+    m_pool.enqueue(rasterizeBands);
+  }
+  rasterizeBands();
+  std::unique_lock<std::mutex> lock(bands->mutex);
+  bands->condition.wait(lock, [&]() { return bands->doneCount == bandCount; });
+}
+
+void OcclusionBuffer::rasterizeBand(int firstRow, int lastRow)
+{
+  auto &depths = m_levels[0];
+  for (const auto &triangle : m_triangles) {
+    const auto &v = triangle.vertices;
+    // Pixels whose center is inside the bounding box of the triangle
+    const auto windowMin = glm::min(v[0], glm::min(v[1], v[2]));
+    const auto windowMax = glm::max(v[0], glm::max(v[1], v[2]));
+    const auto minX = std::max(0, int(std::ceil(windowMin.x - 0.5f)));
+    const auto maxX =
+        std::min(m_width - 1, int(std::floor(windowMax.x - 0.5f)));
+    const auto minY = std::max(firstRow, int(std::ceil(windowMin.y - 0.5f)));
+    const auto maxY =
+        std::min(lastRow - 1, int(std::floor(windowMax.y - 0.5f)));
+    if (minX > maxX || minY > maxY) {
+      continue;
+    }
+
+    // Edge functions a * x + b * y + c, positive inside the counter-clockwise
+    // triangle, and depth plane z = dzdx * x + dzdy * y + z0
+    float a[3], b[3], c[3];
+    for (int e = 0; e < 3; ++e) {
+      const auto &from = v[e];
+      const auto &to = v[(e + 1) % 3];
+      a[e] = from.y - to.y;
+      b[e] = to.x - from.x;
+      c[e] = -(a[e] * from.x + b[e] * from.y);
+    }
+    const auto d1 = v[1] - v[0];
+    const auto d2 = v[2] - v[0];
+    const auto area = d1.x * d2.y - d1.y * d2.x;
+    const auto dzdx = (d1.z * d2.y - d2.z * d1.y) / area;
+    const auto dzdy = (d2.z * d1.x - d1.z * d2.x) / area;
+    const auto z0 = v[0].z - dzdx * v[0].x - dzdy * v[0].y;
+
+    for (auto y = minY; y <= maxY; ++y) {
+      const auto centerY = float(y) + 0.5f;
+      auto *row = depths.data() + size_t(y) * m_width;
+      auto x = minX;
+#ifdef OCCLUSION_SSE
+      // 4 pixels at a time from a multiple of 4: rows are padded to 4 pixels
+      x &= ~3;
+      const auto rowZ = _mm_set1_ps(dzdy * centerY + z0);
+      const auto zStep = _mm_set1_ps(dzdx);
+      __m128 edgeSteps[3], rowEdges[3];
+      for (int e = 0; e < 3; ++e) {
+        edgeSteps[e] = _mm_set1_ps(a[e]);
+        rowEdges[e] = _mm_set1_ps(b[e] * centerY + c[e]);
+      }
+      const auto zero = _mm_setzero_ps();
+      for (; x <= maxX; x += 4) {
+        const auto centerX = _mm_add_ps(
+            _mm_set1_ps(float(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+        auto inside = _mm_cmpge_ps(
+            _mm_add_ps(_mm_mul_ps(edgeSteps[0], centerX), rowEdges[0]), zero);
+        for (int e = 1; e < 3; ++e) {
+          inside = _mm_and_ps(inside,
+              _mm_cmpge_ps(
+                  _mm_add_ps(_mm_mul_ps(edgeSteps[e], centerX), rowEdges[e]),
+                  zero));
+        }
+        if (!_mm_movemask_ps(inside)) {
+          continue;
+        }
+        const auto z = _mm_add_ps(_mm_mul_ps(zStep, centerX), rowZ);
+        const auto depth = _mm_loadu_ps(row + x);
+        const auto nearest = _mm_min_ps(depth, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest),
+                                   _mm_andnot_ps(inside, depth)));
+      }
+#endif
+      for (; x <= maxX; ++x) {
+        const auto centerX = float(x) + 0.5f;
+        if (a[0] * centerX + b[0] * centerY + c[0] >= 0.f &&
+            a[1] * centerX + b[1] * centerY + c[1] >= 0.f &&
+            a[2] * centerX + b[2] * centerY + c[2] >= 0.f) {
+          row[x] = std::min(row[x], dzdx * centerX + dzdy * centerY + z0);
+        }
+      }
+    }
+  }
+}
+
+void OcclusionBuffer::buildPyramid()
+{
+  for (size_t level = 1; level < m_levels.size(); ++level) {
+    const auto &source = m_levels[level - 1];
+    const auto sourceSize = m_levelSizes[level - 1];
+    auto &destination = m_levels[level];
+    const auto size = m_levelSizes[level];
+    for (int y = 0; y < size.y; ++y) {
+      const auto *row0 = source.data() + size_t(2 * y) * sourceSize.x;
+      const auto *row1 =
+          source.data() + size_t(std::min(2 * y + 1, sourceSize.y - 1)) *
+                              sourceSize.x;
+      for (int x = 0; x < size.x; ++x) {
+        const auto x1 = std::min(2 * x + 1, sourceSize.x - 1);
+        destination[size_t(y) * size.x + x] =
+            std::max(std::max(row0[2 * x], row0[x1]),
+                std::max(row1[2 * x], row1[x1]));
+      }
+    }
+  }
+}
+
+bool OcclusionBuffer::isVisible(
+    const Bounds &box, const glm::mat4 &viewProjMatrix) const
+{
+  if (box.empty()) {
+    return false;
+  }
+  const auto halfSize = glm::vec2(m_width, m_height) * 0.5f;
+  auto windowMin = glm::vec3(std::numeric_limits<float>::max());
+  auto windowMax = glm::vec3(std::numeric_limits<float>::lowest());
+  // Corners from the min corner and the transformed edges of the box
+  const auto clipMin = viewProjMatrix * glm::vec4(box.min, 1.f);
+  const auto extent = box.max - box.min;
+  const glm::vec4 clipEdges[3] = {viewProjMatrix[0] * extent.x,
+      viewProjMatrix[1] * extent.y, viewProjMatrix[2] * extent.z};
+  for (int corner = 0; corner < 8; ++corner) {
+    auto clip = clipMin;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (corner & (1 << axis)) {
+        clip += clipEdges[axis];
+      }
+    }
+    if (clip.w <= 0.f || clip.z < -clip.w) {
+      return true; // Crosses the near plane
+    }
+    const auto ndc = glm::vec3(clip) / clip.w;
+    const auto window = glm::vec3(
+        (glm::vec2(ndc) + 1.f) * halfSize, ndc.z * 0.5f + 0.5f);
+    windowMin = glm::min(windowMin, window);
+    windowMax = glm::max(windowMax, window);
+  }
+  if (windowMax.x < 0.f || windowMax.y < 0.f || windowMin.x >= m_width ||
+      windowMin.y >= m_height) {
+    return true; // Off screen: left to frustum culling
+  }
+
+  // Pixels touched by the screen rectangle, then the pyramid level where they
+  // span at most 2x2 texels
+  auto x0 = std::max(0, int(windowMin.x));
+  auto y0 = std::max(0, int(windowMin.y));
+  auto x1 = std::min(m_width - 1, int(windowMax.x));
+  auto y1 = std::min(m_height - 1, int(windowMax.y));
+  size_t level = 0;
+  while (level + 1 < m_levels.size() && std::max(x1 - x0, y1 - y0) > 1) {
+    ++level;
+    x0 >>= 1;
+    y0 >>= 1;
+    x1 >>= 1;
+    y1 >>= 1;
+  }
+  const auto &depths = m_levels[level];
+  const auto width = m_levelSizes[level].x;
+  auto farthest = 0.f;
+  for (auto y = y0; y <= y1; ++y) {
+    for (auto x = x0; x <= x1; ++x) {
+      farthest = std::max(farthest, depths[size_t(y) * width + x]);
+    }
+  }
+  return windowMin.z <= farthest;
+}
+
+std::vector<std::vector<OccluderMesh>> buildOccluderMeshes(
+    const tinygltf::Model &model, const GltfBuffers &buffers,
+    size_t maxTriangleCount)
+{
+  std::vector<std::vector<OccluderMesh>> meshes(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    meshes[meshIdx].resize(primitives.size());
+    for (size_t primIdx = 0; primIdx < primitives.size(); ++primIdx) {
+      const auto &primitive = primitives[primIdx];
+      const auto positionIt = primitive.attributes.find("POSITION");
+      if ((primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode >= 0) ||
+          positionIt == end(primitive.attributes)) {
+        continue;
+      }
+      const auto &positionAccessor = model.accessors[positionIt->second];
+      if (positionAccessor.type != TINYGLTF_TYPE_VEC3 ||
+          positionAccessor.bufferView < 0 ||
+          positionAccessor.count > 3 * maxTriangleCount) {
+        continue;
+      }
+
+      auto &occluder = meshes[meshIdx][primIdx];
+      if (primitive.indices >= 0) {
+        const auto &indexAccessor = model.accessors[primitive.indices];
+        if (indexAccessor.bufferView < 0 ||
+            indexAccessor.count / 3 > maxTriangleCount) {
+          continue;
+        }
+        occluder.indices = readIndices(model, buffers, indexAccessor);
+      } else {
+        occluder.indices.resize(positionAccessor.count);
+        for (size_t i = 0; i < positionAccessor.count; ++i) {
+          occluder.indices[i] = uint32_t(i);
+        }
+      }
+      if (std::any_of(begin(occluder.indices), end(occluder.indices),
+              [&](uint32_t index) {
+                return index >= positionAccessor.count;
+              })) {
+        occluder = OccluderMesh();
+        continue;
+      }
+      occluder.positions = readPositions(model, buffers, positionAccessor);
+      if (occluder.positions.empty()) {
+        occluder = OccluderMesh();
+      }
+    }
+  }
+  return meshes;
+}
+
+size_t cullOccludedInstances(OcclusionBuffer &buffer,
+    const PrimitiveInstances &instances, const FlatSceneGraph &graph,
+    const std::vector<std::vector<OccluderMesh>> &occluderMeshes,
+    const glm::mat4 &viewProjMatrix, size_t triangleBudget,
+    std::vector<uint8_t> &visible, OcclusionStats &stats)
+{
+  stats = OcclusionStats();
+  const auto start = std::chrono::steady_clock::now();
+
+  // Visible instances with an occluder mesh, the largest on screen first
+  std::vector<std::pair<float, int>> candidates;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const auto &occluder =
+        occluderMeshes[instances.meshes[i]][instances.primitives[i]];
+    if (!visible[i] || occluder.indices.empty()) {
+      continue;
+    }
+    const auto &box = instances.worldBounds[i];
+    const auto clip =
+        viewProjMatrix * glm::vec4((box.min + box.max) * 0.5f, 1.f);
+    const auto size = glm::length(box.max - box.min) / std::max(clip.w, 1e-6f);
+    if (clip.w > 0.f && size >= MIN_OCCLUDER_SIZE) {
+      candidates.emplace_back(size, int(i));
+    }
+  }
+  std::sort(begin(candidates), end(candidates),
+      [](const std::pair<float, int> &a, const std::pair<float, int> &b) {
+        return a.first > b.first;
+      });
+
+  buffer.clear();
+  size_t triangleCount = 0;
+  for (const auto &candidate : candidates) {
+    const auto i = candidate.second;
+    const auto &occluder =
+        occluderMeshes[instances.meshes[i]][instances.primitives[i]];
+    if (triangleCount + occluder.indices.size() / 3 > triangleBudget) {
+      continue;
+    }
+    triangleCount += occluder.indices.size() / 3;
+    buffer.addOccluder(occluder.positions, occluder.indices,
+        viewProjMatrix * getWorldMatrix(instances, graph, i));
+    ++stats.occluderCount;
+  }
+  stats.triangleCount = buffer.triangleCount();
+  buffer.rasterize();
+  const auto rasterized = std::chrono::steady_clock::now();
+  buffer.buildPyramid();
+  const auto pyramidBuilt = std::chrono::steady_clock::now();
+
+  size_t visibleCount = 0;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    if (!visible[i]) {
+      continue;
+    }
+    if (buffer.isVisible(instances.worldBounds[i], viewProjMatrix)) {
+      ++visibleCount;
+    } else {
+      visible[i] = 0;
+      ++stats.occludedCount;
+    }
+  }
+  const auto tested = std::chrono::steady_clock::now();
+
+  stats.rasterizeMilliseconds = getMilliseconds(start, rasterized);
+  stats.pyramidMilliseconds = getMilliseconds(rasterized, pyramidBuilt);
+  stats.testMilliseconds = getMilliseconds(pyramidBuilt, tested);
+  return visibleCount;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "bounds.hpp"
+#include "culling.hpp"
+#include "gltf_loader.hpp"
+#include "scene_graph.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Low resolution depth buffer filled on the CPU by rasterizing occluders, and
+// its depth pyramid (hierarchical Z) against which bounds are tested. Depths
+// are window depths in [0, 1] of OpenGL projections, 1 being the far plane.
+// Rasterization is vectorized with SSE when available and split in horizontal
+// bands, shared between the calling thread and the workers of pool.
+class OcclusionBuffer
+{
+public:
+  // width is rounded up to a multiple of 4. pool must outlive the buffer.
+  OcclusionBuffer(ThreadPool &pool, int width, int height);
+
+  // Non-copyable class:
+  OcclusionBuffer(const OcclusionBuffer &) = delete;
+  OcclusionBuffer &operator=(const OcclusionBuffer &) = delete;
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+
+  // Remove the occluders and reset the depths to the far plane
+  void clear();
+
+  // Queue the triangles of indices, positions being transformed by
+  // modelViewProjMatrix. Triangles crossing the near plane are skipped: a
+  // missing occluder only makes the tests more conservative.
+  void addOccluder(const std::vector<glm::vec3> &positions,
+      const std::vector<uint32_t> &indices,
+      const glm::mat4 &modelViewProjMatrix);
+
+  size_t triangleCount() const { return m_triangles.size(); }
+
+  // Rasterize the queued occluders, then build the depth pyramid
+  void rasterize();
+  void buildPyramid();
+
+  // Whether box, in the space transformed by viewProjMatrix, may be visible:
+  // false if its nearest depth is behind the farthest depth of the pyramid
+  // texels covering its screen rectangle
+  bool isVisible(const Bounds &box, const glm::mat4 &viewProjMatrix) const;
+
+  // Depths of level 0, row by row from the bottom of the window
+  const std::vector<float> &depths() const { return m_levels[0]; }
+
+private:
+  // Window coordinates of the vertices: x and y in pixels, z as depth
+  struct Triangle
+  {
+    glm::vec3 vertices[3];
+  };
+
+  void rasterizeBand(int firstRow, int lastRow);
+
+  int m_width;
+  int m_height;
+  std::vector<Triangle> m_triangles;
+  std::vector<glm::vec3> m_windowPositions; // Used by addOccluder()
+  // Level i + 1 holds the max of 2x2 texels of level i
+  std::vector<std::vector<float>> m_levels;
+  std::vector<glm::ivec2> m_levelSizes;
+  ThreadPool &m_pool;
+};
+
+// Triangles of each mesh primitive suitable as occluder, indexed by mesh then
+// primitive. Primitives that are not triangles with VEC3 positions, or with
+// more than maxTriangleCount triangles, get no triangles.
+struct OccluderMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+std::vector<std::vector<OccluderMesh>> buildOccluderMeshes(
+    const tinygltf::Model &model, const GltfBuffers &buffers,
+    size_t maxTriangleCount);
+
+struct OcclusionStats
+{
+  size_t occluderCount = 0;
+  size_t triangleCount = 0;
+  size_t occludedCount = 0;
+  double rasterizeMilliseconds = 0;
+  double pyramidMilliseconds = 0;
+  double testMilliseconds = 0;
+};
+
+// Rasterize the largest on-screen visible instances that have an occluder
+// mesh, up to triangleBudget triangles, then clear visible[i] for the visible
+// instances hidden behind them. Return the number of instances left visible.
+size_t cullOccludedInstances(OcclusionBuffer &buffer,
+    const PrimitiveInstances &instances, const FlatSceneGraph &graph,
+    const std::vector<std::vector<OccluderMesh>> &occluderMeshes,
+    const glm::mat4 &viewProjMatrix, size_t triangleBudget,
+    std::vector<uint8_t> &visible, OcclusionStats &stats);
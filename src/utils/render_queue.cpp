@@ -0,0 +1,82 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <utility>
+
+namespace
+{
+
+// Small enough for the histogram to stay in the L1 cache
+const int DIGIT_BITS = 8;
+const size_t DIGIT_COUNT = size_t(1) << DIGIT_BITS;
+
+uint64_t getField(uint64_t value, int bits)
+{
+  return value & ((uint64_t(1) << bits) - 1);
+}
+
+} // namespace
+
+std::vector<int> computeTextureSets(const tinygltf::Model &model)
+{
+  std::map<std::array<int, 5>, int> textureSetIds;
+  std::vector<int> textureSets;
+  textureSets.reserve(model.materials.size());
+  for (const auto &material : model.materials) {
+    const std::array<int, 5> textures{
+        material.pbrMetallicRoughness.baseColorTexture.index,
+        material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+        material.emissiveTexture.index, material.occlusionTexture.index,
+        material.normalTexture.index};
+    const auto it =
+        textureSetIds.emplace(textures, int(textureSetIds.size())).first;
+    textureSets.push_back(it->second);
+  }
+  return textureSets;
+}
+
+uint64_t makeDrawKey(
+    int textureSet, int material, size_t vertexArray, int lodLevel)
+{
+  return (getField(uint64_t(textureSet + 1), 16) << 48) |
+         (getField(uint64_t(material + 1), 24) << 24) |
+         (getField(vertexArray, 21) << 3) | getField(uint64_t(lodLevel), 3);
+}
+
+void sortDrawItems(std::vector<DrawItem> &items, std::vector<DrawItem> &scratch)
+{
+  if (items.size() < 2) {
+    return;
+  }
+  scratch.resize(items.size());
+
+  // Bits that differ between keys: the digits without any are already
+  // sorted
+  uint64_t differingBits = 0;
+  for (const auto &item : items) {
+    differingBits |= item.key ^ items[0].key;
+  }
+
+  std::array<uint32_t, DIGIT_COUNT> offsets;
+  for (int shift = 0; shift < 64; shift += DIGIT_BITS) {
+    if (((differingBits >> shift) & (DIGIT_COUNT - 1)) == 0) {
+      continue;
+    }
+    std::fill(begin(offsets), end(offsets), 0);
+    for (const auto &item : items) {
+      ++offsets[(item.key >> shift) & (DIGIT_COUNT - 1)];
+    }
+    uint32_t offset = 0;
+    for (auto &count : offsets) {
+      const auto digitCount = count;
+      count = offset;
+      offset += digitCount;
+    }
+    for (const auto &item : items) {
+      scratch[offsets[(item.key >> shift) & (DIGIT_COUNT - 1)]++] = item;
+    }
+    std::swap(items, scratch);
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One draw of a frame: the state it needs packed in a sort key, and the
+// primitive instance it draws
+struct DrawItem
+{
+  uint64_t key;
+  uint32_t instance; // In PrimitiveInstances
+};
+
+// Identifier of the set of textures of each material: materials sampling the
+// same textures share it, so that they are drawn next to each other
+std::vector<int> computeTextureSets(const tinygltf::Model &model);
+
+// Key sorting draws by the state the most expensive to change first: texture
+// set (16 bits), then material (24 bits), then vertex array (21 bits), then
+// level of detail (3 bits). -1 stands for the default material and its
+// textures. Larger values wrap, which only makes the order less efficient.
+// Draws of the same primitive with the same material and level end up next
+// to each other, ready to be instanced.
+uint64_t makeDrawKey(
+    int textureSet, int material, size_t vertexArray, int lodLevel);
+
+// Sort items by key with a stable LSD radix sort over 8-bit digits, skipping
+// the digits shared by every key. scratch is resized to items.size() and
+// reused to avoid allocations from one frame to the next.
+void sortDrawItems(
+    std::vector<DrawItem> &items, std::vector<DrawItem> &scratch);
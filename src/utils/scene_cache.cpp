@@ -0,0 +1,714 @@
+#include "scene_cache.hpp"
+#include "gltf.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+namespace
+{
+
+const uint64_t CACHE_MAGIC = 0x454843414356474Cull; // "LGVCACHE"
+// Increment when the layout or content changes, older entries are then ignored
+const uint32_t CACHE_VERSION = 4;
+const size_t BLOB_ALIGNMENT = 16;
+
+size_t alignUp(size_t offset)
+{
+  return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+// A file the cache entry was built from
+struct Dependency
+{
+  std::string path;
+  int64_t modificationTime = 0;
+  uint64_t size = 0;
+  uint64_t contentHash = 0;
+};
+
+// Location of a blob relative to the end of the description
+struct Blob
+{
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+int64_t modificationTime(const fs::path &path)
+{
+  return int64_t(fs::last_write_time(path).time_since_epoch().count());
+}
+
+uint64_t hashFile(const fs::path &path)
+{
+  const MappedFile file(path);
+  return hashBytes(file.data(), file.size());
+}
+
+// Serialization of the model description
+
+struct Writer
+{
+  std::vector<unsigned char> bytes;
+  // Model being written, the node extensions are read against it
+  const tinygltf::Model *model = nullptr;
+
+  void append(const void *data, size_t size)
+  {
+    const auto *p = static_cast<const unsigned char *>(data);
+    bytes.insert(end(bytes), p, p + size);
+  }
+};
+
+struct Reader
+{
+  const unsigned char *p;
+  const unsigned char *pEnd;
+
+  void read(void *data, size_t size)
+  {
+    if (size > size_t(pEnd - p)) {
+      throw std::runtime_error("Truncated scene cache entry");
+    }
+    std::memcpy(data, p, size);
+    p += size;
+  }
+};
+
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type put(
+    Writer &w, T value)
+{
+  w.append(&value, sizeof(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type get(
+    Reader &r, T &value)
+{
+  r.read(&value, sizeof(value));
+}
+
+void put(Writer &w, const std::string &value);
+void get(Reader &r, std::string &value);
+void put(Writer &w, const Dependency &value);
+void get(Reader &r, Dependency &value);
+void put(Writer &w, const Blob &value);
+void get(Reader &r, Blob &value);
+void put(Writer &w, const tinygltf::Scene &value);
+void get(Reader &r, tinygltf::Scene &value);
+void put(Writer &w, const tinygltf::Node &value);
+void get(Reader &r, tinygltf::Node &value);
+void put(Writer &w, const tinygltf::Primitive &value);
+void get(Reader &r, tinygltf::Primitive &value);
+void put(Writer &w, const tinygltf::Mesh &value);
+void get(Reader &r, tinygltf::Mesh &value);
+void put(Writer &w, const tinygltf::Accessor &value);
+void get(Reader &r, tinygltf::Accessor &value);
+void put(Writer &w, const tinygltf::BufferView &value);
+void get(Reader &r, tinygltf::BufferView &value);
+void put(Writer &w, const tinygltf::Material &value);
+void get(Reader &r, tinygltf::Material &value);
+void put(Writer &w, const tinygltf::Texture &value);
+void get(Reader &r, tinygltf::Texture &value);
+void put(Writer &w, const tinygltf::Sampler &value);
+void get(Reader &r, tinygltf::Sampler &value);
+void put(Writer &w, const tinygltf::Image &value);
+void get(Reader &r, tinygltf::Image &value);
+void put(Writer &w, const LodLevel &value);
+void get(Reader &r, LodLevel &value);
+
+template <typename T> void put(Writer &w, const std::vector<T> &values)
+{
+  put(w, uint64_t(values.size()));
+  for (const auto &value : values) {
+    put(w, value);
+  }
+}
+
+template <typename T> void get(Reader &r, std::vector<T> &values)
+{
+  uint64_t count;
+  get(r, count);
+  if (count > uint64_t(r.pEnd - r.p)) { // Every element takes a byte at least
+    throw std::runtime_error("Invalid scene cache entry");
+  }
+  values.resize(size_t(count));
+  for (auto &value : values) {
+    get(r, value);
+  }
+}
+
+void put(Writer &w, const std::map<std::string, int> &values)
+{
+  put(w, uint64_t(values.size()));
+  for (const auto &value : values) {
+    put(w, value.first);
+    put(w, value.second);
+  }
+}
+
+void get(Reader &r, std::map<std::string, int> &values)
+{
+  uint64_t count;
+  get(r, count);
+  for (uint64_t i = 0; i < count; ++i) {
+    std::string key;
+    get(r, key);
+    get(r, values[key]);
+  }
+}
+
+void put(Writer &w, const std::string &value)
+{
+  put(w, uint64_t(value.size()));
+  w.append(value.data(), value.size());
+}
+
+void get(Reader &r, std::string &value)
+{
+  uint64_t size;
+  get(r, size);
+  if (size > uint64_t(r.pEnd - r.p)) {
+    throw std::runtime_error("Truncated scene cache entry");
+  }
+  value.assign(reinterpret_cast<const char *>(r.p), size_t(size));
+  r.p += size;
+}
+
+void put(Writer &w, const Dependency &value)
+{
+  put(w, value.path);
+  put(w, value.modificationTime);
+  put(w, value.size);
+  put(w, value.contentHash);
+}
+
+void get(Reader &r, Dependency &value)
+{
+  get(r, value.path);
+  get(r, value.modificationTime);
+  get(r, value.size);
+  get(r, value.contentHash);
+}
+
+void put(Writer &w, const Blob &value)
+{
+  put(w, value.offset);
+  put(w, value.size);
+}
+
+void get(Reader &r, Blob &value)
+{
+  get(r, value.offset);
+  get(r, value.size);
+}
+
+// The GPU byteOffset is set again by packLodIndices()
+void put(Writer &w, const LodLevel &value)
+{
+  put(w, uint64_t(value.firstIndex));
+  put(w, uint64_t(value.indexCount));
+  put(w, value.error);
+}
+
+void get(Reader &r, LodLevel &value)
+{
+  uint64_t firstIndex, indexCount;
+  get(r, firstIndex);
+  get(r, indexCount);
+  get(r, value.error);
+  value.firstIndex = size_t(firstIndex);
+  value.indexCount = size_t(indexCount);
+}
+
+void put(Writer &w, const tinygltf::Scene &value) { put(w, value.nodes); }
+
+void get(Reader &r, tinygltf::Scene &value) { get(r, value.nodes); }
+
+void put(Writer &w, const tinygltf::Node &value)
+{
+  put(w, value.mesh);
+  put(w, value.children);
+  put(w, value.matrix);
+  put(w, value.translation);
+  put(w, value.rotation);
+  put(w, value.scale);
+  // Only the extensions and extras read by the viewer
+  const auto lod = getMsftLod(*w.model, value);
+  put(w, lod.ids);
+  put(w, lod.screenCoverages);
+  put(w, getGpuInstancingAttributes(value));
+}
+
+void get(Reader &r, tinygltf::Node &value)
+{
+  get(r, value.mesh);
+  get(r, value.children);
+  get(r, value.matrix);
+  get(r, value.translation);
+  get(r, value.rotation);
+  get(r, value.scale);
+  MsftLod lod;
+  get(r, lod.ids);
+  get(r, lod.screenCoverages);
+  if (!lod.ids.empty()) {
+    tinygltf::Value::Array ids(begin(lod.ids), end(lod.ids));
+    tinygltf::Value::Object extension;
+    extension["ids"] = tinygltf::Value(ids);
+    value.extensions["MSFT_lod"] = tinygltf::Value(extension);
+  }
+  if (!lod.screenCoverages.empty()) {
+    tinygltf::Value::Array coverages(
+        begin(lod.screenCoverages), end(lod.screenCoverages));
+    tinygltf::Value::Object extras;
+    extras["MSFT_screencoverage"] = tinygltf::Value(coverages);
+    value.extras = tinygltf::Value(extras);
+  }
+  std::map<std::string, int> instancingAttributes;
+  get(r, instancingAttributes);
+  if (!instancingAttributes.empty()) {
+    tinygltf::Value::Object attributes;
+    for (const auto &attribute : instancingAttributes) {
+      attributes[attribute.first] = tinygltf::Value(attribute.second);
+    }
+    tinygltf::Value::Object extension;
+    extension["attributes"] = tinygltf::Value(attributes);
+    value.extensions["EXT_mesh_gpu_instancing"] = tinygltf::Value(extension);
+  }
+}
+
+void put(Writer &w, const tinygltf::Primitive &value)
+{
+  put(w, value.attributes);
+  put(w, value.material);
+  put(w, value.indices);
+  put(w, value.mode);
+}
+
+void get(Reader &r, tinygltf::Primitive &value)
+{
+  get(r, value.attributes);
+  get(r, value.material);
+  get(r, value.indices);
+  get(r, value.mode);
+}
+
+void put(Writer &w, const tinygltf::Mesh &value) { put(w, value.primitives); }
+
+void get(Reader &r, tinygltf::Mesh &value) { get(r, value.primitives); }
+
+void put(Writer &w, const tinygltf::Accessor &value)
+{
+  put(w, value.bufferView);
+  put(w, uint64_t(value.byteOffset));
+  put(w, uint8_t(value.normalized));
+  put(w, value.componentType);
+  put(w, uint64_t(value.count));
+  put(w, value.type);
+  put(w, value.minValues);
+  put(w, value.maxValues);
+}
+
+void get(Reader &r, tinygltf::Accessor &value)
+{
+  uint64_t byteOffset, count;
+  uint8_t normalized;
+  get(r, value.bufferView);
+  get(r, byteOffset);
+  get(r, normalized);
+  get(r, value.componentType);
+  get(r, count);
+  get(r, value.type);
+  get(r, value.minValues);
+  get(r, value.maxValues);
+  value.byteOffset = size_t(byteOffset);
+  value.normalized = normalized != 0;
+  value.count = size_t(count);
+}
+
+void put(Writer &w, const tinygltf::BufferView &value)
+{
+  put(w, value.buffer);
+  put(w, uint64_t(value.byteOffset));
+  put(w, uint64_t(value.byteLength));
+  put(w, uint64_t(value.byteStride));
+  put(w, value.target);
+}
+
+void get(Reader &r, tinygltf::BufferView &value)
+{
+  uint64_t byteOffset, byteLength, byteStride;
+  get(r, value.buffer);
+  get(r, byteOffset);
+  get(r, byteLength);
+  get(r, byteStride);
+  get(r, value.target);
+  value.byteOffset = size_t(byteOffset);
+  value.byteLength = size_t(byteLength);
+  value.byteStride = size_t(byteStride);
+}
+
+void put(Writer &w, const tinygltf::Material &value)
+{
+  const auto &pbr = value.pbrMetallicRoughness;
+  put(w, pbr.baseColorFactor);
+  put(w, pbr.baseColorTexture.index);
+  put(w, pbr.baseColorTexture.texCoord);
+  put(w, pbr.metallicFactor);
+  put(w, pbr.roughnessFactor);
+  put(w, pbr.metallicRoughnessTexture.index);
+  put(w, pbr.metallicRoughnessTexture.texCoord);
+  put(w, value.normalTexture.index);
+  put(w, value.normalTexture.texCoord);
+  put(w, value.normalTexture.scale);
+  put(w, value.occlusionTexture.index);
+  put(w, value.occlusionTexture.texCoord);
+  put(w, value.occlusionTexture.strength);
+  put(w, value.emissiveTexture.index);
+  put(w, value.emissiveTexture.texCoord);
+  put(w, value.emissiveFactor);
+  put(w, value.alphaMode);
+  put(w, value.alphaCutoff);
+  put(w, uint8_t(value.doubleSided));
+}
+
+void get(Reader &r, tinygltf::Material &value)
+{
+  auto &pbr = value.pbrMetallicRoughness;
+  uint8_t doubleSided;
+  get(r, pbr.baseColorFactor);
+  get(r, pbr.baseColorTexture.index);
+  get(r, pbr.baseColorTexture.texCoord);
+  get(r, pbr.metallicFactor);
+  get(r, pbr.roughnessFactor);
+  get(r, pbr.metallicRoughnessTexture.index);
+  get(r, pbr.metallicRoughnessTexture.texCoord);
+  get(r, value.normalTexture.index);
+  get(r, value.normalTexture.texCoord);
+  get(r, value.normalTexture.scale);
+  get(r, value.occlusionTexture.index);
+  get(r, value.occlusionTexture.texCoord);
+  get(r, value.occlusionTexture.strength);
+  get(r, value.emissiveTexture.index);
+  get(r, value.emissiveTexture.texCoord);
+  get(r, value.emissiveFactor);
+  get(r, value.alphaMode);
+  get(r, value.alphaCutoff);
+  get(r, doubleSided);
+  value.doubleSided = doubleSided != 0;
+}
+
+void put(Writer &w, const tinygltf::Texture &value)
+{
+  put(w, value.sampler);
+  put(w, value.source);
+}
+
+void get(Reader &r, tinygltf::Texture &value)
+{
+  get(r, value.sampler);
+  get(r, value.source);
+}
+
+void put(Writer &w, const tinygltf::Sampler &value)
+{
+  put(w, value.minFilter);
+  put(w, value.magFilter);
+  put(w, value.wrapS);
+  put(w, value.wrapT);
+  put(w, value.wrapR);
+}
+
+void get(Reader &r, tinygltf::Sampler &value)
+{
+  get(r, value.minFilter);
+  get(r, value.magFilter);
+  get(r, value.wrapS);
+  get(r, value.wrapT);
+  get(r, value.wrapR);
+}
+
+// Texels are stored as a blob, not here
+void put(Writer &w, const tinygltf::Image &value)
+{
+  put(w, value.width);
+  put(w, value.height);
+  put(w, value.component);
+  put(w, value.bits);
+  put(w, value.pixel_type);
+  put(w, value.bufferView);
+  put(w, value.uri);
+  put(w, value.mimeType);
+}
+
+void get(Reader &r, tinygltf::Image &value)
+{
+  get(r, value.width);
+  get(r, value.height);
+  get(r, value.component);
+  get(r, value.bits);
+  get(r, value.pixel_type);
+  get(r, value.bufferView);
+  get(r, value.uri);
+  get(r, value.mimeType);
+}
+
+// Files whose content is baked in the entry: the glTF file itself and the
+// external buffers and images it references
+std::vector<fs::path> listDependencies(
+    const fs::path &gltfFile, const tinygltf::Model &model)
+{
+  std::vector<fs::path> paths{gltfFile};
+  for (const auto &buffer : model.buffers) {
+    if (!buffer.uri.empty()) {
+      paths.push_back(gltfFile.parent_path() / buffer.uri);
+    }
+  }
+  for (const auto &image : model.images) {
+    if (!image.uri.empty()) {
+      paths.push_back(gltfFile.parent_path() / image.uri);
+    }
+  }
+  return paths;
+}
+
+bool isUpToDate(const Dependency &dependency)
+{
+  const fs::path path{dependency.path};
+  std::error_code error;
+  if (!fs::exists(path, error) || fs::file_size(path) != dependency.size) {
+    return false;
+  }
+  if (modificationTime(path) == dependency.modificationTime) {
+    return true;
+  }
+  // Touched but maybe not modified, e.g. by a version control checkout
+  return hashFile(path) == dependency.contentHash;
+}
+
+} // namespace
+
+SceneCache::SceneCache(const fs::path &directory) : m_directory{directory} {}
+
+fs::path SceneCache::entryPath(const fs::path &gltfFile) const
+{
+  const auto key = fs::absolute(gltfFile).string();
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0')
+     << hashBytes(key.data(), key.size()) << ".scene";
+  return m_directory / ss.str();
+}
+
+bool SceneCache::load(const fs::path &gltfFile, tinygltf::Model &model,
+    GltfBuffers &buffers, LodChains &lods) const
+{
+  const auto path = entryPath(gltfFile);
+  std::error_code error;
+  if (!fs::exists(path, error)) {
+    return false;
+  }
+
+  try {
+    MappedFile file(path);
+    Reader reader{file.data(), file.data() + file.size()};
+
+    uint64_t magic;
+    uint32_t version;
+    get(reader, magic);
+    get(reader, version);
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+      return false;
+    }
+
+    std::vector<Dependency> dependencies;
+    get(reader, dependencies);
+    for (const auto &dependency : dependencies) {
+      if (!isUpToDate(dependency)) {
+        std::clog << "Scene cache entry " << path << " is stale" << std::endl;
+        return false;
+      }
+    }
+
+    tinygltf::Model cachedModel;
+    std::vector<std::string> bufferUris;
+    std::vector<Blob> bufferBlobs, imageBlobs;
+    LodChains cachedLods;
+    Blob lodIndexBlob;
+    get(reader, cachedModel.defaultScene);
+    get(reader, cachedModel.scenes);
+    get(reader, cachedModel.nodes);
+    get(reader, cachedModel.meshes);
+    get(reader, cachedModel.accessors);
+    get(reader, cachedModel.bufferViews);
+    get(reader, cachedModel.materials);
+    get(reader, cachedModel.textures);
+    get(reader, cachedModel.samplers);
+    get(reader, cachedModel.images);
+    get(reader, bufferUris);
+    get(reader, bufferBlobs);
+    get(reader, imageBlobs);
+    get(reader, cachedLods.meshes);
+    get(reader, lodIndexBlob);
+    if (imageBlobs.size() != cachedModel.images.size() ||
+        cachedLods.meshes.size() != cachedModel.meshes.size()) {
+      return false;
+    }
+
+    const auto blobsOffset = alignUp(size_t(reader.p - file.data()));
+    const auto toSpan = [&](const Blob &blob) {
+      if (blobsOffset + blob.offset + blob.size > file.size()) {
+        throw std::runtime_error("Truncated scene cache entry");
+      }
+      return ByteSpan{file.data() + blobsOffset + blob.offset, blob.size};
+    };
+
+    GltfBuffers cachedBuffers;
+    for (size_t i = 0; i < bufferBlobs.size(); ++i) {
+      cachedModel.buffers.emplace_back();
+      cachedModel.buffers.back().uri = bufferUris[i];
+      cachedBuffers.spans.push_back(toSpan(bufferBlobs[i]));
+    }
+    for (const auto &blob : imageBlobs) {
+      cachedBuffers.decodedImages.push_back(toSpan(blob));
+    }
+    cachedBuffers.encodedImages.resize(cachedModel.images.size());
+    // Copied: packLodIndices() and the GPU upload read a vector
+    const auto lodIndices = toSpan(lodIndexBlob);
+    cachedLods.indices.resize(lodIndices.size / sizeof(uint32_t));
+    std::memcpy(cachedLods.indices.data(), lodIndices.data,
+        cachedLods.indices.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < cachedLods.meshes.size(); ++i) {
+      const auto &mesh = cachedLods.meshes[i];
+      if (mesh.size() != cachedModel.meshes[i].primitives.size()) {
+        throw std::runtime_error("Invalid scene cache entry");
+      }
+      for (const auto &levels : mesh) {
+        for (const auto &level : levels) {
+          if (level.firstIndex + level.indexCount > cachedLods.indices.size()) {
+            throw std::runtime_error("Invalid scene cache entry");
+          }
+        }
+      }
+    }
+    cachedBuffers.mappedFiles.emplace_back(std::move(file));
+
+    model = std::move(cachedModel);
+    buffers = std::move(cachedBuffers);
+    lods = std::move(cachedLods);
+  } catch (const std::exception &e) {
+    std::cerr << "Unable to read scene cache entry " << path << ": "
+              << e.what() << std::endl;
+    return false;
+  }
+
+  std::clog << "Loaded " << gltfFile << " from scene cache " << path
+            << std::endl;
+  return true;
+}
+
+bool SceneCache::store(const fs::path &gltfFile, const tinygltf::Model &model,
+    const GltfBuffers &buffers, const LodChains &lods) const
+{
+  const auto path = entryPath(gltfFile);
+  const auto tmpPath = fs::path(path.string() + ".tmp");
+
+  try {
+    std::vector<Dependency> dependencies;
+    for (const auto &dependencyPath : listDependencies(gltfFile, model)) {
+      Dependency dependency;
+      dependency.path = fs::absolute(dependencyPath).string();
+      dependency.modificationTime = modificationTime(dependencyPath);
+      dependency.size = fs::file_size(dependencyPath);
+      dependency.contentHash = hashFile(dependencyPath);
+      dependencies.push_back(dependency);
+    }
+
+    // Blobs are laid out after the description, each one aligned
+    std::vector<ByteSpan> blobSpans;
+    std::vector<Blob> bufferBlobs, imageBlobs;
+    uint64_t blobsSize = 0;
+    const auto addBlob = [&](const ByteSpan &span, std::vector<Blob> &blobs) {
+      blobs.push_back(Blob{blobsSize, span.size});
+      blobSpans.push_back(span);
+      blobsSize = alignUp(size_t(blobsSize + span.size));
+    };
+    std::vector<std::string> bufferUris;
+    for (size_t i = 0; i < model.buffers.size(); ++i) {
+      addBlob(buffers.spans[i], bufferBlobs);
+      bufferUris.push_back(model.buffers[i].uri);
+    }
+    for (size_t i = 0; i < model.images.size(); ++i) {
+      addBlob(getImagePixels(model, buffers, int(i)), imageBlobs);
+    }
+    std::vector<Blob> lodIndexBlob;
+    addBlob(ByteSpan{reinterpret_cast<const unsigned char *>(
+                         lods.indices.data()),
+                lods.indices.size() * sizeof(uint32_t)},
+        lodIndexBlob);
+
+    Writer writer;
+    writer.model = &model;
+    put(writer, CACHE_MAGIC);
+    put(writer, CACHE_VERSION);
+    put(writer, dependencies);
+    put(writer, model.defaultScene);
+    put(writer, model.scenes);
+    put(writer, model.nodes);
+    put(writer, model.meshes);
+    put(writer, model.accessors);
+    put(writer, model.bufferViews);
+    put(writer, model.materials);
+    put(writer, model.textures);
+    put(writer, model.samplers);
+    put(writer, model.images);
+    put(writer, bufferUris);
+    put(writer, bufferBlobs);
+    put(writer, imageBlobs);
+    put(writer, lods.meshes);
+    put(writer, lodIndexBlob[0]);
+    writer.bytes.resize(alignUp(writer.bytes.size()), 0);
+
+    fs::create_directories(m_directory);
+    std::ofstream output(tmpPath.string(), std::ios::binary);
+    output.write(reinterpret_cast<const char *>(writer.bytes.data()),
+        writer.bytes.size());
+    const char padding[BLOB_ALIGNMENT] = {};
+    for (const auto &span : blobSpans) {
+      output.write(reinterpret_cast<const char *>(span.data), span.size);
+      output.write(padding, alignUp(span.size) - span.size);
+    }
+    output.close();
+    if (!output) {
+      throw std::runtime_error("Unable to write " + tmpPath.string());
+    }
+
+    // Readers never see a partially written entry
+    fs::rename(tmpPath, path);
+  } catch (const std::exception &e) {
+    std::cerr << "Unable to store scene cache entry " << path << ": "
+              << e.what() << std::endl;
+    std::error_code error;
+    fs::remove(tmpPath, error);
+    return false;
+  }
+
+  std::clog << "Stored " << gltfFile << " in scene cache " << path
+            << std::endl;
+  return true;
+}
+
+void SceneCache::invalidate(const fs::path &gltfFile) const
+{
+  std::error_code error;
+  fs::remove(entryPath(gltfFile), error);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf_loader.hpp"
+#include "lod.hpp"
+
+#include <tiny_gltf.h>
+
+// On-disk cache of loaded scenes, one file per source glTF in a directory.
+// A cache file stores what the viewer uses of the tinygltf::Model in a compact
+// binary form (nodes, meshes, accessors, materials...), followed by the raw
+// buffer contents and the decoded image texels. Loading it only reads the small
+// model description: buffers and texels are memory-mapped, so JSON parsing,
+// data URI and image decoding are all skipped. The levels of detail generated
+// for the primitives are stored too, to skip their generation.
+//
+// An entry is valid as long as the source file and the external files it
+// references have the same size and either the same modification time or the
+// same content hash as when the entry was stored.
+class SceneCache
+{
+public:
+  explicit SceneCache(const fs::path &directory);
+
+  // Load the cached entry of gltfFile. On success, model and buffers are
+  // filled as by loadGltf() with images already decoded: their texels are in
+  // buffers.decodedImages, and lods as by buildLodChains(). Return false on
+  // cache miss or stale entry.
+  bool load(const fs::path &gltfFile, tinygltf::Model &model,
+      GltfBuffers &buffers, LodChains &lods) const;
+
+  // Write the entry of gltfFile. Images must have been decoded.
+  bool store(const fs::path &gltfFile, const tinygltf::Model &model,
+      const GltfBuffers &buffers, const LodChains &lods) const;
+
+  // Remove the entry of gltfFile, if any
+  void invalidate(const fs::path &gltfFile) const;
+
+private:
+  fs::path entryPath(const fs::path &gltfFile) const;
+
+  fs::path m_directory;
+};
@@ -0,0 +1,112 @@
+#include "scene_graph.hpp"
+#include "gltf.hpp"
+#include "scene_visitor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+
+void updateRange(FlatSceneGraph &graph, int first, int last)
+{
+  for (auto i = first; i < last; ++i) {
+    const auto parent = graph.parents[i];
+    graph.worldMatrices[i] =
+        parent < 0 ? graph.localMatrices[i]
+                   : graph.worldMatrices[parent] * graph.localMatrices[i];
+    graph.normalMatrices[i] = computeNormalMatrix(graph.worldMatrices[i]);
+  }
+  graph.updatedRanges.emplace_back(first, last);
+}
+
+} // namespace
+
+FlatSceneGraph flattenSceneGraph(const tinygltf::Model &model, int sceneIdx)
+{
+  FlatSceneGraph graph;
+
+  // Positions of the nodes being visited, from the root: a node is appended
+  // when entered, its subtree ends when it is left
+  std::vector<int> path;
+  visitScene(
+      model, sceneIdx,
+      [&](int nodeIdx, const glm::mat4 &) {
+        const auto &node = model.nodes[nodeIdx];
+        graph.parents.push_back(path.empty() ? -1 : path.back());
+        graph.nodes.push_back(nodeIdx);
+        graph.meshes.push_back(node.mesh);
+        graph.localMatrices.push_back(
+            getLocalToWorldMatrix(node, glm::mat4(1)));
+        graph.subtreeEnds.push_back(0);
+        path.push_back(int(graph.size()) - 1);
+        return true;
+      },
+      [&](int, const glm::mat4 &) {
+        graph.subtreeEnds[path.back()] = int(graph.size());
+        path.pop_back();
+      });
+
+  graph.worldMatrices.resize(graph.size());
+  graph.normalMatrices.resize(graph.size());
+  updateWorldMatrices(graph);
+  return graph;
+}
+
+glm::mat3 computeNormalMatrix(const glm::mat4 &worldMatrix)
+{
+  const glm::mat3 linear(worldMatrix);
+  const auto squaredLength0 = glm::dot(linear[0], linear[0]);
+  const auto squaredLength1 = glm::dot(linear[1], linear[1]);
+  const auto squaredLength2 = glm::dot(linear[2], linear[2]);
+  // Relative to the squared scale, as are the dot products below
+  const auto tolerance = 1e-5f * squaredLength0;
+  const auto isUniformScaleRotation =
+      std::abs(squaredLength1 - squaredLength0) <= tolerance &&
+      std::abs(squaredLength2 - squaredLength0) <= tolerance &&
+      std::abs(glm::dot(linear[0], linear[1])) <= tolerance &&
+      std::abs(glm::dot(linear[0], linear[2])) <= tolerance &&
+      std::abs(glm::dot(linear[1], linear[2])) <= tolerance;
+  // s * R has (s * R)^-T = R / s: same directions as the matrix itself
+  return isUniformScaleRotation ? linear
+                                : glm::transpose(glm::inverse(linear));
+}
+
+void updateWorldMatrices(FlatSceneGraph &graph)
+{
+  graph.dirtyNodes.clear();
+  graph.updatedRanges.clear();
+  updateRange(graph, 0, int(graph.size()));
+}
+
+void setLocalMatrix(
+    FlatSceneGraph &graph, int nodePosition, const glm::mat4 &localMatrix)
+{
+  graph.localMatrices[nodePosition] = localMatrix;
+  graph.dirtyNodes.push_back(nodePosition);
+}
+
+size_t updateDirtyWorldMatrices(FlatSceneGraph &graph)
+{
+  graph.updatedRanges.clear();
+  if (graph.dirtyNodes.empty()) {
+    return 0;
+  }
+
+  // In depth-first order, a dirty node inside the subtree of the previous one
+  // is updated with it
+  std::sort(begin(graph.dirtyNodes), end(graph.dirtyNodes));
+  size_t updatedCount = 0;
+  auto updatedEnd = 0;
+  for (const auto node : graph.dirtyNodes) {
+    if (node < updatedEnd) {
+      continue;
+    }
+    updatedEnd = graph.subtreeEnds[node];
+    updateRange(graph, node, updatedEnd);
+    updatedCount += updatedEnd - node;
+  }
+  graph.dirtyNodes.clear();
+  return updatedCount;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <utility>
+#include <vector>
+
+// Node hierarchy of a glTF scene flattened once at load in a table, in
+// depth-first order: a parent always comes before its children, so that world
+// matrices are updated in one linear pass without recursion, and the subtree
+// of a node is a contiguous range. Each column is indexed by the position of
+// the node in the table, not by its index in model.nodes.
+struct FlatSceneGraph
+{
+  std::vector<int> parents; // Position of the parent, -1 for root nodes
+  std::vector<int> subtreeEnds; // Position after the last descendant
+  std::vector<int> nodes; // Index in model.nodes
+  std::vector<int> meshes; // Index in model.meshes, -1 if none
+  std::vector<glm::mat4> localMatrices; // Modified with setLocalMatrix()
+  std::vector<glm::mat4> worldMatrices; // See updateWorldMatrices()
+  // Inverse-transpose of the upper 3x3 of each world matrix, up to a scale
+  // factor: normals must be normalized after the transformation. Updated
+  // with worldMatrices.
+  std::vector<glm::mat3> normalMatrices;
+
+  // Nodes whose local matrix changed since the last update: their subtree is
+  // dirty
+  std::vector<int> dirtyNodes;
+  // Ranges [first, last) of positions whose world matrix was recomputed by the
+  // last update, for the data derived from it to follow
+  std::vector<std::pair<int, int>> updatedRanges;
+
+  size_t size() const { return nodes.size(); }
+};
+
+// Flatten the nodes of model.scenes[sceneIdx], with world matrices up to date.
+// Return an empty graph if sceneIdx < 0.
+FlatSceneGraph flattenSceneGraph(const tinygltf::Model &model, int sceneIdx);
+
+// Matrix transforming normals by worldMatrix, up to a scale factor. Rotations
+// with a uniform scale, the common case, are their own normal matrix up to
+// that scale: the general inverse is skipped for them.
+glm::mat3 computeNormalMatrix(const glm::mat4 &worldMatrix);
+
+// Recompute every world and normal matrix from the local ones
+void updateWorldMatrices(FlatSceneGraph &graph);
+
+// Change the local matrix of the node at position nodePosition and mark its
+// subtree dirty
+void setLocalMatrix(
+    FlatSceneGraph &graph, int nodePosition, const glm::mat4 &localMatrix);
+
+// Recompute the world and normal matrices of the dirty subtrees only, so that
+// the cost follows what changed rather than the size of the scene. Return the
+// number of nodes updated (0 for a static scene).
+size_t updateDirtyWorldMatrices(FlatSceneGraph &graph);
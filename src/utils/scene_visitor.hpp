@@ -0,0 +1,68 @@
+#pragma once
+
+#include "gltf.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <vector>
+
+// Depth-first traversal of the nodes of model.scenes[sceneIdx], in the order
+// of their children, with their world matrix. For each node:
+// - enter(nodeIdx, worldMatrix) is called first (pre-order) and returns
+// whether to visit the children of the node: false prunes its subtree;
+// - leave(nodeIdx, worldMatrix) is called once its subtree has been visited
+// or pruned (post-order).
+// The functors are template parameters, inlined in the loop. The traversal
+// uses an explicit stack, as deep as the hierarchy, instead of recursion so
+// that deep hierarchies cannot overflow the call stack. Nothing is visited if
+// sceneIdx < 0.
+template <typename Enter, typename Leave>
+void visitScene(
+    const tinygltf::Model &model, int sceneIdx, Enter &&enter, Leave &&leave)
+{
+  if (sceneIdx < 0) {
+    return;
+  }
+
+  struct Frame
+  {
+    int nodeIdx;
+    size_t nextChild;
+    glm::mat4 worldMatrix;
+  };
+  std::vector<Frame> stack;
+  const auto visitNode = [&](int nodeIdx, const glm::mat4 &parentMatrix) {
+    const auto worldMatrix =
+        getLocalToWorldMatrix(model.nodes[nodeIdx], parentMatrix);
+    if (enter(nodeIdx, worldMatrix)) {
+      stack.push_back(Frame{nodeIdx, 0, worldMatrix});
+    } else {
+      leave(nodeIdx, worldMatrix);
+    }
+  };
+
+  for (const auto rootIdx : model.scenes[sceneIdx].nodes) {
+    visitNode(rootIdx, glm::mat4(1));
+    while (!stack.empty()) {
+      auto &frame = stack.back();
+      const auto &children = model.nodes[frame.nodeIdx].children;
+      if (frame.nextChild < children.size()) {
+        // Copied: pushing the child may move the frame
+        const auto parentMatrix = frame.worldMatrix;
+        visitNode(children[frame.nextChild++], parentMatrix);
+      } else {
+        leave(frame.nodeIdx, frame.worldMatrix);
+        stack.pop_back();
+      }
+    }
+  }
+}
+
+// Pre-order only traversal, see above
+template <typename Enter>
+void visitScene(const tinygltf::Model &model, int sceneIdx, Enter &&enter)
+{
+  visitScene(model, sceneIdx, enter, [](int, const glm::mat4 &) {});
+}
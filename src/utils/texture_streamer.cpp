@@ -0,0 +1,237 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace
+{
+
+int getMipLevelCount(int width, int height)
+{
+  auto levelCount = 1;
+  for (auto size = std::max(width, height); size > 1; size /= 2) {
+    ++levelCount;
+  }
+  return levelCount;
+}
+
+// 2x2 box filter, the last row / column is repeated for odd sizes
+template <typename ComponentType>
+void downsample(const ComponentType *src, int srcWidth, int srcHeight,
+    int numComponents, ComponentType *dst, int dstWidth, int dstHeight)
+{
+  for (int y = 0; y < dstHeight; ++y) {
+    const auto *row0 = src + size_t(std::min(2 * y, srcHeight - 1)) *
+                                 srcWidth * numComponents;
+    const auto *row1 = src + size_t(std::min(2 * y + 1, srcHeight - 1)) *
+                                 srcWidth * numComponents;
+    for (int x = 0; x < dstWidth; ++x) {
+      const auto x0 = std::min(2 * x, srcWidth - 1) * numComponents;
+      const auto x1 = std::min(2 * x + 1, srcWidth - 1) * numComponents;
+      for (int c = 0; c < numComponents; ++c) {
+        const uint32_t sum = uint32_t(row0[x0 + c]) + row0[x1 + c] +
+                             row1[x0 + c] + row1[x1 + c];
+        *dst++ = ComponentType((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(ThreadPool &pool,
+    const tinygltf::Model &model, const GltfBuffers &buffers,
+    ImageDecodeQueue &imageDecodeQueue) :
+    m_pool(pool),
+    m_model(model),
+    m_buffers(buffers),
+    m_imageDecodeQueue(imageDecodeQueue),
+    m_textures(model.textures.size(), 0),
+    m_hasLevels(model.textures.size(), false),
+    m_imageToTextures(model.images.size()),
+    m_images(model.images.size()),
+    m_remainingCount(model.images.size())
+{
+  glGenTextures(GLsizei(m_textures.size()), m_textures.data());
+  for (size_t i = 0; i < model.textures.size(); ++i) {
+    if (model.textures[i].source >= 0) {
+      m_imageToTextures[model.textures[i].source].push_back(int(i));
+    }
+  }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_runningCount == 0; });
+  }
+  glDeleteTextures(GLsizei(m_textures.size()), m_textures.data());
+}
+
+void TextureStreamer::update(size_t byteBudget)
+{
+  int imageIdx;
+  while ((imageIdx = m_imageDecodeQueue.tryPop()) >= 0) {
+    enqueueImage(imageIdx);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto builtIdx : m_built) {
+      auto &stream = m_images[builtIdx];
+      stream.nextLevel = int(stream.levels.size()) - 1;
+      m_uploading.push_back(builtIdx);
+    }
+    m_built.clear();
+  }
+
+  size_t uploadedBytes = 0;
+  while (!m_uploading.empty()) {
+    // Smallest pending level first, whatever its image: every texture gets a
+    // coarse version before any gets its full resolution
+    const auto levelSize = [this](int idx) {
+      return m_images[idx].levels[m_images[idx].nextLevel].size;
+    };
+    const auto it = std::min_element(begin(m_uploading), end(m_uploading),
+        [&](int lhs, int rhs) { return levelSize(lhs) < levelSize(rhs); });
+
+    const auto size = levelSize(*it);
+    if (uploadedBytes > 0 && uploadedBytes + size > byteBudget) {
+      break;
+    }
+    uploadedBytes += size;
+
+    auto &stream = m_images[*it];
+    uploadLevel(*it);
+    if (stream.nextLevel < 0) {
+      stream = ImageStream{}; // Release the mip chain
+      *it = m_uploading.back();
+      m_uploading.pop_back();
+      --m_remainingCount;
+    }
+  }
+}
+
+void TextureStreamer::finish()
+{
+  int imageIdx;
+  while ((imageIdx = m_imageDecodeQueue.pop()) >= 0) {
+    enqueueImage(imageIdx);
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_runningCount == 0; });
+  }
+  update(std::numeric_limits<size_t>::max());
+}
+
+bool TextureStreamer::done() const { return m_remainingCount == 0; }
+
+GLuint TextureStreamer::texture(int textureIdx) const
+{
+  return m_hasLevels[textureIdx] ? m_textures[textureIdx] : 0;
+}
+
+void TextureStreamer::enqueueImage(int imageIdx)
+{
+  const auto pixels = getImagePixels(m_model, m_buffers, imageIdx);
+  if (!pixels.data || m_imageToTextures[imageIdx].empty()) {
+    if (!m_imageToTextures[imageIdx].empty()) {
+      std::cerr << "Image " << imageIdx << " could not be decoded\n";
+    }
+    --m_remainingCount;
+    return;
+  }
+  m_images[imageIdx].levels.push_back(pixels);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ++m_runningCount;
+  m_pool.enqueue([this, imageIdx]() {
+    buildMipmaps(imageIdx);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_built.push_back(imageIdx);
+    --m_runningCount;
+    m_condition.notify_all();
+  });
+}
+
+void TextureStreamer::buildMipmaps(int imageIdx)
+{
+  const auto &image = m_model.images[imageIdx];
+  auto &stream = m_images[imageIdx];
+
+  const auto levelCount = getMipLevelCount(image.width, image.height);
+  const auto componentSize = image.bits == 16 ? 2 : 1;
+  stream.ownedLevels.reserve(levelCount - 1);
+
+  auto width = image.width;
+  auto height = image.height;
+  for (int level = 1; level < levelCount; ++level) {
+    const auto levelWidth = std::max(1, width / 2);
+    const auto levelHeight = std::max(1, height / 2);
+    stream.ownedLevels.emplace_back(size_t(levelWidth) * levelHeight *
+                                    image.component * componentSize);
+    auto &texels = stream.ownedLevels.back();
+
+    const auto *src = stream.levels.back().data;
+    if (componentSize == 2) {
+      downsample((const uint16_t *)src, width, height, image.component,
+          (uint16_t *)texels.data(), levelWidth, levelHeight);
+    } else {
+      downsample(src, width, height, image.component, texels.data(),
+          levelWidth, levelHeight);
+    }
+    stream.levels.push_back({texels.data(), texels.size()});
+
+    width = levelWidth;
+    height = levelHeight;
+  }
+}
+
+void TextureStreamer::uploadLevel(int imageIdx)
+{
+  const auto &image = m_model.images[imageIdx];
+  auto &stream = m_images[imageIdx];
+  const auto level = stream.nextLevel;
+
+  tinygltf::Sampler defaultSampler;
+  defaultSampler.minFilter = GL_LINEAR;
+  defaultSampler.magFilter = GL_LINEAR;
+  defaultSampler.wrapS = GL_REPEAT;
+  defaultSampler.wrapT = GL_REPEAT;
+  defaultSampler.wrapR = GL_REPEAT;
+
+  for (const auto textureIdx : m_imageToTextures[imageIdx]) {
+    glBindTexture(GL_TEXTURE_2D, m_textures[textureIdx]);
+
+    if (!m_hasLevels[textureIdx]) {
+      const auto &texture = m_model.textures[textureIdx];
+      const auto &sampler = texture.sampler >= 0
+                                ? m_model.samplers[texture.sampler]
+                                : defaultSampler;
+      const auto levelCount = GLsizei(stream.levels.size());
+      glTexStorage2D(GL_TEXTURE_2D, levelCount,
+          image.bits == 16 ? GL_RGBA16 : GL_RGBA8, image.width, image.height);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+          sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+          sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
+      m_hasLevels[textureIdx] = true;
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0,
+        std::max(1, image.width >> level), std::max(1, image.height >> level),
+        GL_RGBA, image.pixel_type, stream.levels[level].data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  --stream.nextLevel;
+}
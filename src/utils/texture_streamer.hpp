@@ -0,0 +1,79 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "image_decoder.hpp"
+#include "thread_pool.hpp"
+
+#include <glad/glad.h>
+#include <tiny_gltf.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Upload the textures of a model progressively from the render loop, so that
+// the first frames are drawn before the images are loaded.
+// Once an image is decoded, its mip chain is built on the thread pool and then
+// uploaded a few levels per frame, from the smallest one to the full
+// resolution. A texture can be sampled as soon as its smallest level is
+// uploaded: GL_TEXTURE_BASE_LEVEL restricts sampling to the uploaded levels.
+class TextureStreamer
+{
+public:
+  // Textures are created right away, without storage
+  TextureStreamer(ThreadPool &pool, const tinygltf::Model &model,
+      const GltfBuffers &buffers, ImageDecodeQueue &imageDecodeQueue);
+
+  // Wait for the running tasks and delete the textures
+  ~TextureStreamer();
+
+  // Non-copyable class:
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  // Upload mip levels until byteBudget bytes of texels have been sent. At least
+  // one level is uploaded if any is ready, even if larger than the budget.
+  void update(size_t byteBudget);
+
+  // Block until every texture is fully uploaded
+  void finish();
+
+  // True once every texture is fully uploaded
+  bool done() const;
+
+  // GL texture of model.textures[textureIdx], or 0 while none of its levels
+  // is uploaded
+  GLuint texture(int textureIdx) const;
+
+private:
+  struct ImageStream
+  {
+    std::vector<ByteSpan> levels; // levels[0] is the decoded image
+    std::vector<std::vector<unsigned char>> ownedLevels; // levels[1..]
+    int nextLevel = -1; // Next level to upload, -1 if none
+  };
+
+  // Build the mip chain of a decoded image on the thread pool
+  void enqueueImage(int imageIdx);
+  void buildMipmaps(int imageIdx);
+  void uploadLevel(int imageIdx);
+
+  ThreadPool &m_pool;
+  const tinygltf::Model &m_model;
+  const GltfBuffers &m_buffers;
+  ImageDecodeQueue &m_imageDecodeQueue;
+
+  std::vector<GLuint> m_textures; // One per model.textures
+  std::vector<bool> m_hasLevels; // One per model.textures
+  std::vector<std::vector<int>> m_imageToTextures;
+
+  std::vector<ImageStream> m_images; // One per model.images
+  std::vector<int> m_uploading; // Images with mip levels left to upload
+  size_t m_remainingCount = 0; // Images not fully uploaded yet
+
+  std::deque<int> m_built; // Images with a mip chain ready to upload
+  size_t m_runningCount = 0; // Tasks not finished yet
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+};
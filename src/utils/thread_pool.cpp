@@ -0,0 +1,53 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  m_workers.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    m_workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.emplace_back(std::move(task));
+  }
+  m_condition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(
+          lock, [this]() { return m_stopping || !m_tasks.empty(); });
+      if (m_tasks.empty()) {
+        return; // Stopping and nothing left to do
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads executing tasks in FIFO order
+class ThreadPool
+{
+public:
+  // threadCount == 0 means one thread per hardware thread
+  explicit ThreadPool(size_t threadCount = 0);
+
+  // Run the remaining queued tasks then join the workers
+  ~ThreadPool();
+
+  // Non-copyable class:
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void enqueue(std::function<void()> task);
+
+  size_t size() const { return m_workers.size(); }
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping = false;
+};
@@ -0,0 +1,86 @@
+#include "scene_optimizer.hpp"
+
+#include <utils/filesystem.hpp>
+#include <utils/gltf_loader.hpp>
+
+#include <args.hxx>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+  // args library https://github.com/taywee/args
+  args::ArgumentParser parser{
+      "glTF optimizer. Convert a glTF file to a .glb ready to be rendered by "
+      "gltf-viewer."};
+  args::HelpFlag help{parser, "help", "Display this help menu", {'h', "help"}};
+  args::Positional<std::string> input{parser, "input",
+      "Path to the .gltf or .glb file", args::Options::Required};
+  args::Positional<std::string> output{parser, "output",
+      "Path to the .glb file to write", args::Options::Required};
+  args::Flag noReorder{parser, "no-reorder",
+      "Keep the order of triangles (vertices are still merged and ordered by "
+      "first use)",
+      {"no-reorder"}};
+  args::ValueFlag<float> overdrawThreshold{parser, "threshold",
+      "Vertex cache efficiency traded to reduce overdraw: a cluster of "
+      "triangles ends when its ACMR is below threshold times the mesh ACMR "
+      "(default 1.05)",
+      {"overdraw-threshold"}, 1.05f};
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (const args::Help &) {
+    std::cout << parser;
+    return 0;
+  } catch (const args::Error &e) {
+    std::cerr << e.what() << std::endl;
+    std::cerr << parser;
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  tinygltf::Model model;
+  GltfBuffers buffers;
+  std::string err, warn;
+  if (!loadGltf(args::get(input), model, buffers, err, warn, false)) {
+    std::cerr << "Error while parsing GLTF file: " << err << std::endl;
+    return 1;
+  }
+  if (!warn.empty()) {
+    std::cerr << "Warning: " << warn << std::endl;
+  }
+
+  SceneOptimizerOptions options;
+  options.reorderTriangles = !noReorder;
+  options.overdrawThreshold = args::get(overdrawThreshold);
+  tinygltf::Model optimized;
+  SceneOptimizerStats stats;
+  if (!optimizeScene(model, buffers, options, optimized, stats, err)) {
+    std::cerr << "Unable to optimize " << args::get(input) << ": " << err
+              << std::endl;
+    return 1;
+  }
+  if (!writeGlb(optimized, args::get(output), err)) {
+    std::cerr << err << std::endl;
+    return 1;
+  }
+
+  const auto seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start)
+                           .count();
+  std::printf("%zu primitives, %zu triangles\n", stats.primitiveCount,
+      stats.triangleCount);
+  std::printf("vertices: %zu -> %zu\n", stats.inputVertexCount,
+      stats.outputVertexCount);
+  std::printf("ACMR (16 entries FIFO): %.3f -> %.3f\n", stats.inputAcmr,
+      stats.outputAcmr);
+  std::printf("images: %zu -> %zu, textures: %zu -> %zu\n",
+      stats.inputImageCount, stats.outputImageCount, stats.inputTextureCount,
+      stats.outputTextureCount);
+  std::printf("%s written in %.2f s\n", args::get(output).c_str(), seconds);
+  return 0;
+}
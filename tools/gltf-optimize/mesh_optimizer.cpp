@@ -0,0 +1,331 @@
+#include "mesh_optimizer.hpp"
+
+#include <utils/hash.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+
+const auto NO_INDEX = UINT32_MAX;
+
+// Parameters of Forsyth's scoring function
+const int CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float computeVertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+  if (remainingTriangles == 0) {
+    return -1.f; // Will never be used again
+  }
+  auto score = 0.f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // Used by the last triangle: fixed score so that the next triangle does
+      // not depend on the order of its vertices
+      score = LAST_TRIANGLE_SCORE;
+    } else {
+      const auto scale = 1.f / (CACHE_SIZE - 3);
+      score = std::pow(1.f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+    }
+  }
+  // Favour vertices with few triangles left, to avoid leaving lone triangles
+  // behind
+  return score + VALENCE_BOOST_SCALE *
+                     std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+// Triangles of each vertex in a compressed sparse row layout
+struct VertexTriangles
+{
+  std::vector<uint32_t> offsets; // vertexCount + 1
+  std::vector<uint32_t> triangles;
+
+  VertexTriangles(const uint32_t *indices, size_t indexCount,
+      size_t vertexCount) :
+      offsets(vertexCount + 1, 0), triangles(indexCount)
+  {
+    for (size_t i = 0; i < indexCount; ++i) {
+      ++offsets[indices[i] + 1];
+    }
+    std::partial_sum(begin(offsets), end(offsets), begin(offsets));
+    auto next = offsets;
+    for (size_t i = 0; i < indexCount; ++i) {
+      triangles[next[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+};
+
+} // namespace
+
+size_t weldVertices(const float *vertices, size_t vertexCount,
+    size_t vertexSize, std::vector<uint32_t> &remap)
+{
+  remap.assign(vertexCount, NO_INDEX);
+  const auto vertexBytes = vertexSize * sizeof(float);
+
+  // Open addressing table of the first vertex of each value
+  size_t tableSize = 1;
+  while (tableSize < vertexCount * 2) {
+    tableSize *= 2;
+  }
+  std::vector<uint32_t> table(tableSize, NO_INDEX);
+  const auto mask = tableSize - 1;
+
+  size_t uniqueCount = 0;
+  for (size_t i = 0; i < vertexCount; ++i) {
+    const auto *vertex = vertices + i * vertexSize;
+    auto slot = hashBytes(vertex, vertexBytes) & mask;
+    while (table[slot] != NO_INDEX &&
+           std::memcmp(vertices + table[slot] * vertexSize, vertex,
+               vertexBytes) != 0) {
+      slot = (slot + 1) & mask;
+    }
+    if (table[slot] == NO_INDEX) {
+      table[slot] = uint32_t(i);
+      remap[i] = uint32_t(uniqueCount++);
+    } else {
+      remap[i] = remap[table[slot]];
+    }
+  }
+  return uniqueCount;
+}
+
+void optimizeVertexCache(
+    uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+  const auto triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+  VertexTriangles adjacency(indices, triangleCount * 3, vertexCount);
+
+  std::vector<uint32_t> remainingTriangles(vertexCount);
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    remainingTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    vertexScores[v] = computeVertexScore(-1, remainingTriangles[v]);
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+
+  // LRU cache, plus room for the 3 vertices pushed by a triangle
+  std::vector<uint32_t> cache, nextCache;
+  cache.reserve(CACHE_SIZE + 3);
+  nextCache.reserve(CACHE_SIZE + 3);
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(triangleCount * 3);
+  size_t scanPosition = 0; // Triangles before it have all been emitted
+
+  auto bestTriangle = NO_INDEX;
+  while (sorted.size() < triangleCount * 3) {
+    if (bestTriangle == NO_INDEX) {
+      // Nothing in the cache: restart from the first remaining triangle
+      while (emitted[scanPosition]) {
+        ++scanPosition;
+      }
+      bestTriangle = uint32_t(scanPosition);
+    }
+
+    const auto *triangle = indices + 3 * bestTriangle;
+    emitted[bestTriangle] = true;
+    nextCache.clear();
+    for (int i = 0; i < 3; ++i) {
+      const auto v = triangle[i];
+      sorted.push_back(v);
+      nextCache.push_back(v);
+      // Remove the triangle from the adjacency of its vertices
+      auto *first = adjacency.triangles.data() + adjacency.offsets[v];
+      auto *last = first + remainingTriangles[v];
+      *std::find(first, last, bestTriangle) = *(last - 1);
+      --remainingTriangles[v];
+    }
+    for (const auto v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        nextCache.push_back(v);
+      }
+    }
+    // Vertices falling out of the cache lose their position score
+    for (size_t i = CACHE_SIZE; i < nextCache.size(); ++i) {
+      const auto v = nextCache[i];
+      vertexScores[v] = computeVertexScore(-1, remainingTriangles[v]);
+    }
+    nextCache.resize(std::min(nextCache.size(), size_t(CACHE_SIZE)));
+    std::swap(cache, nextCache);
+
+    // Update the scores of the vertices in the cache and of their triangles,
+    // picking the best one as the next triangle
+    for (size_t i = 0; i < cache.size(); ++i) {
+      const auto v = cache[i];
+      vertexScores[v] = computeVertexScore(int(i), remainingTriangles[v]);
+    }
+    bestTriangle = NO_INDEX;
+    auto bestScore = -1.f;
+    for (const auto v : cache) {
+      const auto *first = adjacency.triangles.data() + adjacency.offsets[v];
+      for (uint32_t i = 0; i < remainingTriangles[v]; ++i) {
+        const auto t = first[i];
+        const auto score = vertexScores[indices[3 * t]] +
+                           vertexScores[indices[3 * t + 1]] +
+                           vertexScores[indices[3 * t + 2]];
+        if (score > bestScore) {
+          bestScore = score;
+          bestTriangle = t;
+        }
+      }
+    }
+  }
+
+  std::copy(begin(sorted), end(sorted), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+    const float *positions, size_t positionStride, size_t vertexCount,
+    float threshold)
+{
+  const auto triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Split the triangles in clusters, ending one where the cache would be
+  // flushed anyway (no vertex shared with the cache) if it is efficient enough
+  const size_t fifoSize = 16;
+  const auto meshAcmr = computeAcmr(indices, indexCount, vertexCount, fifoSize);
+  std::vector<uint32_t> cacheTimes(vertexCount, 0);
+  uint32_t time = fifoSize + 1;
+  std::vector<size_t> clusterStarts{0};
+  size_t clusterMisses = 0;
+  for (size_t t = 0; t < triangleCount; ++t) {
+    size_t misses = 0;
+    for (int i = 0; i < 3; ++i) {
+      const auto v = indices[3 * t + i];
+      if (time - cacheTimes[v] > fifoSize) {
+        cacheTimes[v] = time++;
+        ++misses;
+      }
+    }
+    const auto clusterSize = t - clusterStarts.back();
+    if (misses == 3 && clusterSize > 0 &&
+        double(clusterMisses) / clusterSize <= threshold * meshAcmr) {
+      clusterStarts.push_back(t);
+      clusterMisses = 0;
+    }
+    clusterMisses += misses;
+  }
+  clusterStarts.push_back(triangleCount);
+  const auto clusterCount = clusterStarts.size() - 1;
+  if (clusterCount < 2) {
+    return;
+  }
+
+  // Area weighted centroid and normal of each cluster
+  const auto position = [&](uint32_t v) {
+    const auto *p = positions + size_t(v) * positionStride;
+    return glm::vec3(p[0], p[1], p[2]);
+  };
+  std::vector<glm::vec3> centroids(clusterCount), normals(clusterCount);
+  glm::vec3 meshCentroid(0);
+  auto meshArea = 0.f;
+  for (size_t c = 0; c < clusterCount; ++c) {
+    glm::vec3 centroid(0), normal(0);
+    auto area = 0.f;
+    for (auto t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+      const auto p0 = position(indices[3 * t]);
+      const auto p1 = position(indices[3 * t + 1]);
+      const auto p2 = position(indices[3 * t + 2]);
+      const auto crossProduct = glm::cross(p1 - p0, p2 - p0);
+      const auto triangleArea = glm::length(crossProduct);
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+      normal += crossProduct;
+      area += triangleArea;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    centroids[c] = area > 0.f ? centroid / area
+                              : position(indices[3 * clusterStarts[c]]);
+    const auto length = glm::length(normal);
+    normals[c] = length > 0.f ? normal / length : glm::vec3(0);
+  }
+  if (meshArea > 0.f) {
+    meshCentroid /= meshArea;
+  }
+
+  // Clusters far from the center and facing outwards first
+  std::vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c) {
+    sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+  }
+  std::vector<uint32_t> order(clusterCount);
+  std::iota(begin(order), end(order), 0);
+  std::stable_sort(begin(order), end(order),
+      [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(triangleCount * 3);
+  for (const auto c : order) {
+    sorted.insert(end(sorted), indices + 3 * clusterStarts[c],
+        indices + 3 * clusterStarts[c + 1]);
+  }
+  std::copy(begin(sorted), end(sorted), indices);
+}
+
+size_t optimizeVertexFetch(uint32_t *indices, size_t indexCount,
+    size_t vertexCount, std::vector<uint32_t> &remap)
+{
+  remap.assign(vertexCount, NO_INDEX);
+  size_t usedCount = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    auto &newIndex = remap[indices[i]];
+    if (newIndex == NO_INDEX) {
+      newIndex = uint32_t(usedCount++);
+    }
+    indices[i] = newIndex;
+  }
+  return usedCount;
+}
+
+double computeAcmr(const uint32_t *indices, size_t indexCount,
+    size_t vertexCount, size_t cacheSize)
+{
+  const auto triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return 0.;
+  }
+  // A vertex is in the cache if less than cacheSize misses happened since it
+  // was loaded
+  std::vector<size_t> cacheTimes(vertexCount, 0);
+  auto time = cacheSize + 1;
+  size_t misses = 0;
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    const auto v = indices[i];
+    if (time - cacheTimes[v] > cacheSize) {
+      cacheTimes[v] = time++;
+      ++misses;
+    }
+  }
+  return double(misses) / triangleCount;
+}
+
+std::vector<float> remapVertices(const float *vertices, size_t vertexCount,
+    size_t vertexSize, const std::vector<uint32_t> &remap,
+    size_t newVertexCount)
+{
+  std::vector<float> remapped(newVertexCount * vertexSize);
+  for (size_t i = 0; i < vertexCount; ++i) {
+    if (remap[i] != NO_INDEX) {
+      std::copy(vertices + i * vertexSize, vertices + (i + 1) * vertexSize,
+          remapped.data() + size_t(remap[i]) * vertexSize);
+    }
+  }
+  return remapped;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index and vertex reordering of triangle meshes. Vertices are arrays of
+// vertexSize floats, indices are 32 bits.
+
+// Merge the vertices whose attributes are bitwise identical. Fill remap with
+// the new index of each vertex and return the number of unique vertices.
+size_t weldVertices(const float *vertices, size_t vertexCount,
+    size_t vertexSize, std::vector<uint32_t> &remap);
+
+// Reorder triangles for the post-transform vertex cache (Tom Forsyth, "Linear-
+// Speed Vertex Cache Optimisation").
+void optimizeVertexCache(
+    uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+// Reorder clusters of triangles, as produced by optimizeVertexCache(), so that
+// outer surfaces facing outwards are drawn first and occlude the rest (after
+// Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). A cluster ends when its ACMR is below threshold times the ACMR
+// of the mesh, so threshold trades vertex cache efficiency for overdraw.
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+    const float *positions, size_t positionStride, size_t vertexCount,
+    float threshold = 1.05f);
+
+// Number vertices in order of first use by indices, which are rewritten. Fill
+// remap with the new index of each vertex (UINT32_MAX if unused) and return
+// the number of used vertices.
+size_t optimizeVertexFetch(uint32_t *indices, size_t indexCount,
+    size_t vertexCount, std::vector<uint32_t> &remap);
+
+// Average number of vertices transformed per triangle with a FIFO cache
+double computeAcmr(const uint32_t *indices, size_t indexCount,
+    size_t vertexCount, size_t cacheSize = 16);
+
+// Copy vertices to their remapped location, skipping UINT32_MAX entries
+std::vector<float> remapVertices(const float *vertices, size_t vertexCount,
+    size_t vertexSize, const std::vector<uint32_t> &remap,
+    size_t newVertexCount);
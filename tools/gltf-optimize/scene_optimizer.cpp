@@ -0,0 +1,668 @@
+#include "scene_optimizer.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <utils/hash.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace
+{
+
+// Vertex attributes read by gltf-viewer, with their number of components
+const std::vector<std::pair<std::string, int>> VERTEX_ATTRIBUTES = {
+    {"POSITION", 3}, {"NORMAL", 3}, {"TANGENT", 4}, {"TEXCOORD_0", 2}};
+
+float readComponent(
+    const unsigned char *src, int componentType, bool normalized)
+{
+  const auto read = [&](auto value, float max) {
+    std::memcpy(&value, src, sizeof(value));
+    return normalized ? std::max(float(value) / max, -1.f) : float(value);
+  };
+  switch (componentType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return read(int8_t(), 127.f);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return read(uint8_t(), 255.f);
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    return read(int16_t(), 32767.f);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return read(uint16_t(), 65535.f);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return read(uint32_t(), 4294967295.f);
+  default:
+    return read(float(), 1.f);
+  }
+}
+
+// Pointer to the first element of an accessor, checking that its elements lie
+// in its bufferView; nullptr if it has no bufferView
+const unsigned char *getAccessorData(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor,
+    int &stride, std::string &err)
+{
+  if (accessor.sparse.isSparse) {
+    err = "Sparse accessors are not supported";
+    return nullptr;
+  }
+  if (accessor.bufferView < 0) {
+    return nullptr;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto bytes = getBufferViewBytes(model, buffers, accessor.bufferView);
+  const auto elementSize =
+      tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+      tinygltf::GetNumComponentsInType(accessor.type);
+  stride = accessor.ByteStride(bufferView);
+  if (stride <= 0 ||
+      (accessor.count > 0 &&
+          accessor.byteOffset + (accessor.count - 1) * stride + elementSize >
+              bytes.size)) {
+    err = "Accessor out of the bounds of its bufferView";
+    return nullptr;
+  }
+  return bytes.data + accessor.byteOffset;
+}
+
+// Read componentCount components of each element of an accessor into
+// vertices, starting at offset and every vertexSize floats
+bool readAttribute(const tinygltf::Model &model, const GltfBuffers &buffers,
+    int accessorIdx, int componentCount, size_t offset, size_t vertexSize,
+    float *vertices, std::string &err)
+{
+  const auto &accessor = model.accessors[accessorIdx];
+  if (tinygltf::GetNumComponentsInType(accessor.type) != componentCount) {
+    err = "Unexpected accessor type";
+    return false;
+  }
+  int stride = 0;
+  const auto *data =
+      getAccessorData(model, buffers, accessor, stride, err);
+  if (!data) {
+    return err.empty(); // No bufferView: zeros
+  }
+  const auto componentSize =
+      tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    for (int c = 0; c < componentCount; ++c) {
+      vertices[i * vertexSize + offset + c] =
+          readComponent(data + i * stride + c * componentSize,
+              accessor.componentType, accessor.normalized);
+    }
+  }
+  return true;
+}
+
+bool readIndices(const tinygltf::Model &model, const GltfBuffers &buffers,
+    int accessorIdx, std::vector<uint32_t> &indices, std::string &err)
+{
+  const auto &accessor = model.accessors[accessorIdx];
+  int stride = 0;
+  const auto *data = getAccessorData(model, buffers, accessor, stride, err);
+  if (!data) {
+    if (err.empty()) {
+      err = "Index accessor without bufferView";
+    }
+    return false;
+  }
+  indices.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    const auto *src = data + i * stride;
+    switch (accessor.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      indices[i] = *src;
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+      uint16_t index;
+      std::memcpy(&index, src, sizeof(index));
+      indices[i] = index;
+      break;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      std::memcpy(&indices[i], src, sizeof(uint32_t));
+      break;
+    default:
+      err = "Invalid index component type";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Output buffer being filled with bufferViews
+class BufferBuilder
+{
+public:
+  explicit BufferBuilder(tinygltf::Model &model) : m_model(model)
+  {
+    m_model.buffers.emplace_back(); // Empty uri: the GLB binary chunk
+  }
+
+  int addBufferView(
+      const void *data, size_t size, int byteStride = 0, int target = 0)
+  {
+    auto &bytes = m_model.buffers[0].data;
+    bytes.resize((bytes.size() + 3) & ~size_t(3), 0); // Keep 4 bytes alignment
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = bytes.size();
+    bufferView.byteLength = size;
+    bufferView.byteStride = byteStride;
+    bufferView.target = target;
+    const auto *src = static_cast<const unsigned char *>(data);
+    bytes.insert(end(bytes), src, src + size);
+    m_model.bufferViews.push_back(bufferView);
+    return int(m_model.bufferViews.size()) - 1;
+  }
+
+private:
+  tinygltf::Model &m_model;
+};
+
+// Optimize the vertices and indices of a primitive and add them to optimized;
+// fill outPrimitive attributes and indices
+bool optimizePrimitive(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Primitive &primitive,
+    const SceneOptimizerOptions &options, tinygltf::Model &optimized,
+    BufferBuilder &bufferBuilder, tinygltf::Primitive &outPrimitive,
+    SceneOptimizerStats &stats, std::string &err)
+{
+  const auto positionIt = primitive.attributes.find("POSITION");
+  if (positionIt == end(primitive.attributes)) {
+    err = "Primitive without POSITION";
+    return false;
+  }
+  const auto vertexCount = model.accessors[positionIt->second].count;
+
+  // Interleave the attributes kept
+  std::vector<std::pair<std::string, size_t>> attributeOffsets;
+  size_t vertexSize = 0;
+  for (const auto &attribute : VERTEX_ATTRIBUTES) {
+    const auto it = primitive.attributes.find(attribute.first);
+    if (it != end(primitive.attributes)) {
+      if (model.accessors[it->second].count != vertexCount) {
+        err = "Vertex attributes of different sizes";
+        return false;
+      }
+      attributeOffsets.emplace_back(attribute.first, vertexSize);
+      vertexSize += attribute.second;
+    }
+  }
+  std::vector<float> vertices(vertexCount * vertexSize);
+  for (size_t i = 0; i < attributeOffsets.size(); ++i) {
+    const auto componentCount =
+        i + 1 < attributeOffsets.size()
+            ? attributeOffsets[i + 1].second - attributeOffsets[i].second
+            : vertexSize - attributeOffsets[i].second;
+    if (!readAttribute(model, buffers,
+            primitive.attributes.at(attributeOffsets[i].first),
+            int(componentCount), attributeOffsets[i].second, vertexSize,
+            vertices.data(), err)) {
+      return false;
+    }
+  }
+
+  std::vector<uint32_t> indices;
+  if (primitive.indices >= 0) {
+    if (!readIndices(model, buffers, primitive.indices, indices, err)) {
+      return false;
+    }
+    if (std::any_of(begin(indices), end(indices),
+            [&](uint32_t index) { return index >= vertexCount; })) {
+      err = "Index out of the vertex range";
+      return false;
+    }
+  } else {
+    indices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+      indices[i] = uint32_t(i);
+    }
+  }
+
+  std::vector<uint32_t> remap;
+  auto uniqueCount =
+      weldVertices(vertices.data(), vertexCount, vertexSize, remap);
+  for (auto &index : indices) {
+    index = remap[index];
+  }
+  vertices = remapVertices(
+      vertices.data(), vertexCount, vertexSize, remap, uniqueCount);
+
+  const auto isTriangleList = primitive.mode == TINYGLTF_MODE_TRIANGLES ||
+                              primitive.mode == -1;
+  if (isTriangleList) {
+    const auto triangleCount = indices.size() / 3;
+    stats.triangleCount += triangleCount;
+    stats.inputAcmr += triangleCount * computeAcmr(indices.data(),
+                                           indices.size(), uniqueCount);
+    if (options.reorderTriangles) {
+      optimizeVertexCache(indices.data(), indices.size(), uniqueCount);
+      optimizeOverdraw(indices.data(), indices.size(), vertices.data(),
+          vertexSize, uniqueCount, options.overdrawThreshold);
+    }
+  }
+
+  // Welded vertices are already ordered by first use in the original order
+  const auto usedCount = optimizeVertexFetch(
+      indices.data(), indices.size(), uniqueCount, remap);
+  vertices = remapVertices(
+      vertices.data(), uniqueCount, vertexSize, remap, usedCount);
+  if (isTriangleList) {
+    stats.outputAcmr += (indices.size() / 3) *
+                        computeAcmr(indices.data(), indices.size(), usedCount);
+  }
+  stats.inputVertexCount += vertexCount;
+  stats.outputVertexCount += usedCount;
+
+  const auto vertexBytes = int(vertexSize * sizeof(float));
+  const auto vertexView =
+      bufferBuilder.addBufferView(vertices.data(), vertices.size() * 4,
+          vertexBytes, TINYGLTF_TARGET_ARRAY_BUFFER);
+  for (const auto &attribute : attributeOffsets) {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = vertexView;
+    accessor.byteOffset = attribute.second * sizeof(float);
+    accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+    accessor.count = usedCount;
+    accessor.type = model.accessors[primitive.attributes.at(attribute.first)]
+                        .type;
+    if (attribute.first == "POSITION") { // Bounds are required
+      accessor.minValues.assign(3, std::numeric_limits<double>::max());
+      accessor.maxValues.assign(3, std::numeric_limits<double>::lowest());
+      for (size_t v = 0; v < usedCount; ++v) {
+        for (int c = 0; c < 3; ++c) {
+          const double value = vertices[v * vertexSize + c];
+          accessor.minValues[c] = std::min(accessor.minValues[c], value);
+          accessor.maxValues[c] = std::max(accessor.maxValues[c], value);
+        }
+      }
+    }
+    optimized.accessors.push_back(accessor);
+    outPrimitive.attributes[attribute.first] =
+        int(optimized.accessors.size()) - 1;
+  }
+
+  tinygltf::Accessor indexAccessor;
+  indexAccessor.count = indices.size();
+  indexAccessor.type = TINYGLTF_TYPE_SCALAR;
+  if (usedCount <= std::numeric_limits<uint16_t>::max()) {
+    std::vector<uint16_t> shortIndices(begin(indices), end(indices));
+    indexAccessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    indexAccessor.bufferView = bufferBuilder.addBufferView(shortIndices.data(),
+        shortIndices.size() * sizeof(uint16_t), 0,
+        TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+  } else {
+    indexAccessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+    indexAccessor.bufferView = bufferBuilder.addBufferView(indices.data(),
+        indices.size() * sizeof(uint32_t), 0,
+        TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+  }
+  optimized.accessors.push_back(indexAccessor);
+  outPrimitive.indices = int(optimized.accessors.size()) - 1;
+  return true;
+}
+
+// Copy accessor accessorIdx of model, and the elements it views, to optimized
+// (once, accessorRemap maps the accessors already copied). Return the index of
+// the copy, or -1 if it is sparse or without bufferView.
+int copyAccessor(const tinygltf::Model &model, const GltfBuffers &buffers,
+    int accessorIdx, tinygltf::Model &optimized, BufferBuilder &bufferBuilder,
+    std::map<int, int> &accessorRemap)
+{
+  const auto it = accessorRemap.find(accessorIdx);
+  if (it != end(accessorRemap)) {
+    return it->second;
+  }
+  if (accessorIdx < 0 || size_t(accessorIdx) >= model.accessors.size()) {
+    return -1;
+  }
+  const auto &accessor = model.accessors[accessorIdx];
+  int stride = 0;
+  std::string err;
+  const auto *data = getAccessorData(model, buffers, accessor, stride, err);
+  if (!data) {
+    return -1;
+  }
+  const auto elementSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+             tinygltf::GetNumComponentsInType(accessor.type));
+  std::vector<unsigned char> bytes(accessor.count * elementSize);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    std::memcpy(bytes.data() + i * elementSize, data + i * stride, elementSize);
+  }
+
+  auto copy = accessor;
+  copy.bufferView = bufferBuilder.addBufferView(bytes.data(), bytes.size());
+  copy.byteOffset = 0;
+  optimized.accessors.push_back(copy);
+  const auto copyIdx = int(optimized.accessors.size()) - 1;
+  accessorRemap.emplace(accessorIdx, copyIdx);
+  return copyIdx;
+}
+
+// Whether an extension object references accessors or bufferViews, which
+// optimizeScene() rebuilds
+bool referencesBufferData(const tinygltf::Value &value)
+{
+  if (value.IsArray()) {
+    for (size_t i = 0; i < value.ArrayLen(); ++i) {
+      if (referencesBufferData(value.Get(int(i)))) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (!value.IsObject()) {
+    return false;
+  }
+  for (const auto &member : value.Get<tinygltf::Value::Object>()) {
+    const auto &name = member.first;
+    if (name == "bufferView" || name == "accessor" || name == "attributes" ||
+        name == "indices" || referencesBufferData(member.second)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Remove the extensions of extensions that reference the rebuilt buffer data,
+// warning once per extension name, and add their names to dropped.
+// EXT_mesh_gpu_instancing is kept with its accessors copied.
+void filterExtensions(const tinygltf::Model &model, const GltfBuffers &buffers,
+    tinygltf::ExtensionMap &extensions, tinygltf::Model &optimized,
+    BufferBuilder &bufferBuilder, std::map<int, int> &accessorRemap,
+    std::set<std::string> &dropped)
+{
+  for (auto it = begin(extensions); it != end(extensions);) {
+    auto keep = !referencesBufferData(it->second);
+    if (it->first == "EXT_mesh_gpu_instancing" &&
+        it->second.Has("attributes")) {
+      tinygltf::Value::Object attributes;
+      const auto &object = it->second.Get("attributes");
+      keep = object.IsObject();
+      for (const auto &name : object.Keys()) {
+        const auto copyIdx = copyAccessor(model, buffers,
+            object.Get(name).GetNumberAsInt(), optimized, bufferBuilder,
+            accessorRemap);
+        keep = keep && copyIdx >= 0;
+        attributes[name] = tinygltf::Value(copyIdx);
+      }
+      auto extension = it->second.Get<tinygltf::Value::Object>();
+      extension["attributes"] = tinygltf::Value(attributes);
+      it->second = tinygltf::Value(extension);
+    }
+    if (keep) {
+      ++it;
+      continue;
+    }
+    if (dropped.insert(it->first).second) {
+      std::cerr << "Warning: dropping extension " << it->first
+                << ", its accessors or bufferViews are not kept" << std::endl;
+    }
+    it = extensions.erase(it);
+  }
+}
+
+// Remove name from extensionsUsed and extensionsRequired
+void removeExtensionName(tinygltf::Model &model, const std::string &name)
+{
+  for (auto *names : {&model.extensionsUsed, &model.extensionsRequired}) {
+    names->erase(std::remove(begin(*names), end(*names), name), end(*names));
+  }
+}
+
+std::string getImageMimeType(const tinygltf::Image &image)
+{
+  if (!image.mimeType.empty()) {
+    return image.mimeType;
+  }
+  auto extension = fs::path(image.uri).extension().string();
+  std::transform(begin(extension), end(extension), begin(extension),
+      [](char c) { return char(std::tolower(c)); });
+  return extension == ".png" ? "image/png" : "image/jpeg";
+}
+
+// Merge images with the same encoded bytes; fill imageRemap with the new
+// index of each image
+void addImages(const tinygltf::Model &model, const GltfBuffers &buffers,
+    tinygltf::Model &optimized, BufferBuilder &bufferBuilder,
+    std::vector<int> &imageRemap)
+{
+  std::unordered_multimap<uint64_t, int> imagesByHash;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto &image = model.images[i];
+    const auto bytes = i < buffers.encodedImages.size()
+                           ? buffers.encodedImages[i]
+                           : ByteSpan{};
+    if (!bytes.size) {
+      // Not found when loading: keep referencing it
+      imageRemap.push_back(int(optimized.images.size()));
+      optimized.images.push_back(image);
+      continue;
+    }
+
+    const auto hash = hashBytes(bytes.data, bytes.size);
+    const auto range = imagesByHash.equal_range(hash);
+    const auto same = std::find_if(range.first, range.second, [&](auto &it) {
+      const auto other = buffers.encodedImages[it.second];
+      return other.size == bytes.size &&
+             std::memcmp(other.data, bytes.data, bytes.size) == 0;
+    });
+    if (same != range.second) {
+      imageRemap.push_back(imageRemap[same->second]);
+      continue;
+    }
+    imagesByHash.emplace(hash, int(i));
+
+    tinygltf::Image embedded;
+    embedded.name = image.name;
+    embedded.mimeType = getImageMimeType(image);
+    embedded.bufferView = bufferBuilder.addBufferView(bytes.data, bytes.size);
+    imageRemap.push_back(int(optimized.images.size()));
+    optimized.images.push_back(embedded);
+  }
+}
+
+// Merge textures with the same image and sampler; fill textureRemap with the
+// new index of each texture
+void addTextures(const tinygltf::Model &model,
+    const std::vector<int> &imageRemap, tinygltf::Model &optimized,
+    std::vector<int> &textureRemap)
+{
+  std::map<std::pair<int, int>, int> texturesBySourceAndSampler;
+  for (const auto &texture : model.textures) {
+    auto merged = texture;
+    if (texture.source >= 0) {
+      merged.source = imageRemap[texture.source];
+    }
+    const auto key = std::make_pair(merged.source, merged.sampler);
+    const auto it = texturesBySourceAndSampler.find(key);
+    if (texture.extensions.empty() && it != end(texturesBySourceAndSampler)) {
+      textureRemap.push_back(it->second);
+      continue;
+    }
+    const auto index = int(optimized.textures.size());
+    if (texture.extensions.empty()) {
+      texturesBySourceAndSampler.emplace(key, index);
+    }
+    textureRemap.push_back(index);
+    optimized.textures.push_back(merged);
+  }
+}
+
+// Remap the "index" of the texture infos found in material extensions
+void remapExtensionTextures(
+    tinygltf::Value &value, const std::vector<int> &textureRemap)
+{
+  if (!value.IsObject()) {
+    return;
+  }
+  for (auto &member : value.Get<tinygltf::Value::Object>()) {
+    auto &child = member.second;
+    const auto &name = member.first;
+    const auto isTextureInfo =
+        name.size() >= 7 &&
+        name.compare(name.size() - 7, 7, "Texture") == 0 && child.Has("index");
+    if (isTextureInfo) {
+      auto &index = child.Get<tinygltf::Value::Object>()["index"];
+      if (index.IsInt() && index.Get<int>() >= 0 &&
+          size_t(index.Get<int>()) < textureRemap.size()) {
+        index = tinygltf::Value(textureRemap[index.Get<int>()]);
+      }
+    }
+    remapExtensionTextures(child, textureRemap);
+  }
+}
+
+void remapMaterialTextures(
+    tinygltf::Material &material, const std::vector<int> &textureRemap)
+{
+  const auto remap = [&](int &index) {
+    if (index >= 0) {
+      index = textureRemap[index];
+    }
+  };
+  remap(material.pbrMetallicRoughness.baseColorTexture.index);
+  remap(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+  remap(material.normalTexture.index);
+  remap(material.occlusionTexture.index);
+  remap(material.emissiveTexture.index);
+  for (auto &extension : material.extensions) {
+    remapExtensionTextures(extension.second, textureRemap);
+  }
+}
+
+bool writeNoImage(const std::string *, const std::string *, tinygltf::Image *,
+    bool, void *)
+{
+  return true; // Images are already in bufferViews
+}
+
+} // namespace
+
+bool optimizeScene(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const SceneOptimizerOptions &options, tinygltf::Model &optimized,
+    SceneOptimizerStats &stats, std::string &err)
+{
+  optimized = tinygltf::Model{};
+  stats = SceneOptimizerStats{};
+
+  optimized.asset = model.asset;
+  optimized.asset.generator = "gltf-optimize";
+  optimized.extensionsUsed = model.extensionsUsed;
+  optimized.extensionsRequired = model.extensionsRequired;
+  optimized.extensions = model.extensions;
+  optimized.lights = model.lights;
+  optimized.cameras = model.cameras;
+  optimized.samplers = model.samplers;
+  optimized.scenes = model.scenes;
+  optimized.defaultScene = model.defaultScene;
+  optimized.nodes = model.nodes;
+  for (auto &node : optimized.nodes) {
+    node.skin = -1;
+    node.weights.clear();
+  }
+
+  BufferBuilder bufferBuilder(optimized);
+
+  // Primitives often share their accessors (e.g. one per material): optimize
+  // and store them once
+  std::map<std::vector<int>, tinygltf::Primitive> optimizedPrimitives;
+  for (const auto &mesh : model.meshes) {
+    tinygltf::Mesh outMesh;
+    outMesh.name = mesh.name;
+    outMesh.extras = mesh.extras;
+    for (const auto &primitive : mesh.primitives) {
+      std::vector<int> key{primitive.mode, primitive.indices};
+      for (const auto &attribute : primitive.attributes) {
+        key.push_back(attribute.second);
+      }
+      auto it = optimizedPrimitives.find(key);
+      if (it == end(optimizedPrimitives)) {
+        tinygltf::Primitive outPrimitive;
+        if (!optimizePrimitive(model, buffers, primitive, options, optimized,
+                bufferBuilder, outPrimitive, stats, err)) {
+          err = "Mesh '" + mesh.name + "': " + err;
+          return false;
+        }
+        it = optimizedPrimitives.emplace(key, outPrimitive).first;
+        ++stats.primitiveCount;
+      }
+      auto outPrimitive = it->second;
+      outPrimitive.mode = primitive.mode;
+      outPrimitive.material = primitive.material;
+      outPrimitive.extensions = primitive.extensions;
+      outPrimitive.extras = primitive.extras;
+      outMesh.primitives.push_back(outPrimitive);
+    }
+    optimized.meshes.push_back(outMesh);
+  }
+
+  // Extensions of nodes and primitives referencing the input accessors or
+  // bufferViews would now point to unrelated data
+  std::map<int, int> accessorRemap;
+  std::set<std::string> droppedExtensions;
+  for (auto &node : optimized.nodes) {
+    filterExtensions(model, buffers, node.extensions, optimized,
+        bufferBuilder, accessorRemap, droppedExtensions);
+  }
+  for (auto &mesh : optimized.meshes) {
+    for (auto &primitive : mesh.primitives) {
+      filterExtensions(model, buffers, primitive.extensions, optimized,
+          bufferBuilder, accessorRemap, droppedExtensions);
+    }
+  }
+  for (const auto &name : droppedExtensions) {
+    const auto hasExtension = [&](const auto &object) {
+      return object.extensions.count(name) > 0;
+    };
+    const auto stillUsed =
+        std::any_of(begin(optimized.nodes), end(optimized.nodes),
+            hasExtension) ||
+        std::any_of(begin(optimized.meshes), end(optimized.meshes),
+            [&](const tinygltf::Mesh &mesh) {
+              return std::any_of(begin(mesh.primitives), end(mesh.primitives),
+                  hasExtension);
+            });
+    if (!stillUsed) {
+      removeExtensionName(optimized, name);
+    }
+  }
+
+  if (stats.triangleCount > 0) {
+    stats.inputAcmr /= stats.triangleCount;
+    stats.outputAcmr /= stats.triangleCount;
+  }
+
+  std::vector<int> imageRemap, textureRemap;
+  addImages(model, buffers, optimized, bufferBuilder, imageRemap);
+  addTextures(model, imageRemap, optimized, textureRemap);
+  optimized.materials = model.materials;
+  for (auto &material : optimized.materials) {
+    remapMaterialTextures(material, textureRemap);
+  }
+  stats.inputImageCount = model.images.size();
+  stats.outputImageCount = optimized.images.size();
+  stats.inputTextureCount = model.textures.size();
+  stats.outputTextureCount = optimized.textures.size();
+  return true;
+}
+
+bool writeGlb(tinygltf::Model &model, const fs::path &path, std::string &err)
+{
+  tinygltf::TinyGLTF writer;
+  writer.SetImageWriter(writeNoImage, nullptr);
+  if (!writer.WriteGltfSceneToFile(
+          &model, path.string(), false, false, false, true)) {
+    err = "Unable to write " + path.string();
+    return false;
+  }
+  return true;
+}
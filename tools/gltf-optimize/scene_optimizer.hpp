@@ -0,0 +1,52 @@
+#pragma once
+
+#include <utils/filesystem.hpp>
+#include <utils/gltf_loader.hpp>
+
+#include <tiny_gltf.h>
+
+#include <string>
+
+struct SceneOptimizerOptions
+{
+  // Reorder triangles for the vertex cache and to reduce overdraw
+  bool reorderTriangles = true;
+  // See optimizeOverdraw()
+  float overdrawThreshold = 1.05f;
+};
+
+struct SceneOptimizerStats
+{
+  size_t primitiveCount = 0;
+  size_t inputVertexCount = 0;
+  size_t outputVertexCount = 0;
+  size_t triangleCount = 0;
+  double inputAcmr = 0.; // Averaged over triangles
+  double outputAcmr = 0.;
+  size_t inputImageCount = 0;
+  size_t outputImageCount = 0;
+  size_t inputTextureCount = 0;
+  size_t outputTextureCount = 0;
+};
+
+// Turn a model loaded with loadGltf() into a render-ready one for
+// gltf-viewer, stored in a single buffer to be written as a .glb:
+// - only the vertex attributes read by the viewer are kept, as interleaved
+// floats, with identical vertices merged;
+// - triangles are ordered for the vertex cache, then by cluster to reduce
+// overdraw, and vertices in order of first use;
+// - indices are 16 bits when possible;
+// - identical images (by their encoded bytes) and textures are merged and
+// images are embedded;
+// - animations, skins and morph targets, which the viewer ignores, are
+// dropped;
+// - the accessors of EXT_mesh_gpu_instancing are copied, the other node and
+// primitive extensions referencing accessors or bufferViews (e.g.
+// KHR_draco_mesh_compression) are dropped with a warning.
+// Return false and fill err on failure.
+bool optimizeScene(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const SceneOptimizerOptions &options, tinygltf::Model &optimized,
+    SceneOptimizerStats &stats, std::string &err);
+
+// Write a model built by optimizeScene() as a .glb file
+bool writeGlb(tinygltf::Model &model, const fs::path &path, std::string &err);